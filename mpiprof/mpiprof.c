@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "mpi.h"
+
+//Communication profiler for any of the MPI programs here, through the PMPI interface so the programs are not changed.
+//Build it once and link it ahead of the MPI library, or preload it:
+//  mpicc -O2 -shared -fPIC -o libmpiprof.so mpiprof.c -ldl
+//  mpicc -O2 -o parallelnbody nbody.c -lm -L/path/to/mpiprof -lmpiprof -Wl,-rpath,/path/to/mpiprof
+//  mpirun -np 16 -x LD_PRELOAD=/path/to/libmpiprof.so ga_weasel   (no relink)
+//Every wrapped call is timed and counted per rank, per call, per call site (the return address) and per tag.
+//Bytes are what the call moves at this rank. Time in a call is time blocked, time between calls is compute.
+//Each rank also keeps a timeline of its calls, MPIPROF_EVENTS of them (default 200000), the rest are only counted.
+//At MPI_Finalize rank 0 gathers everything and writes prefix.txt, a per job summary, and prefix.json, a Chrome
+//trace with a row per rank for chrome://tracing or ui.perfetto.dev. The prefix is MPIPROF_PREFIX, default mpiprof.
+//Call sites show as function+offset when the program is linked with -rdynamic, otherwise as file+offset,
+//which addr2line -e program offset turns into a source line.
+
+#define PROF_SITES 4096 //Hash table slots for call, site and tag, a power of two
+#define PROF_SITE_NAME 96
+#define PROF_DEFAULT_EVENTS 200000
+#define NO_TAG INT_MIN //Collectives and completion calls, MPI_ANY_TAG is a tag of its own
+#define OTHER_SITES ((void*)1) //Where calls go once the table is nearly full, one entry per call
+
+enum {CALL_SEND, CALL_RECV, CALL_ISEND, CALL_IRECV, CALL_BCAST, CALL_IBCAST, CALL_REDUCE, CALL_ALLREDUCE, CALL_IALLREDUCE,
+  CALL_GATHER, CALL_GATHERV, CALL_SCATTERV, CALL_ALLTOALL, CALL_BARRIER, CALL_IBARRIER, CALL_WAIT, CALL_WAITANY,
+  CALL_WAITALL, CALL_WAITSOME, CALL_TEST, CALL_IPROBE, CALLS};
+
+static const char* callNames[CALLS] = {"MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv", "MPI_Bcast", "MPI_Ibcast", "MPI_Reduce",
+  "MPI_Allreduce", "MPI_Iallreduce", "MPI_Gather", "MPI_Gatherv", "MPI_Scatterv", "MPI_Alltoall", "MPI_Barrier", "MPI_Ibarrier",
+  "MPI_Wait", "MPI_Waitany", "MPI_Waitall", "MPI_Waitsome", "MPI_Test", "MPI_Iprobe"};
+
+typedef struct {
+  void* site; //NULL for an empty slot
+  int call, tag;
+  long count;
+  long long bytes;
+  double blocked;
+} profSite;
+
+typedef struct { //What a rank sends rank 0 for each site
+  int rank, call, tag;
+  long count;
+  long long bytes;
+  double blocked;
+  char site[PROF_SITE_NAME];
+} profRecord;
+
+typedef struct {
+  double start, end; //Seconds since the barrier in MPI_Init
+  int call;
+} profEvent;
+
+typedef struct { //Per rank totals for the summary
+  double wall, blocked;
+  long calls, droppedEvents;
+  long long bytes;
+  int sites, events;
+} profTotals;
+
+static profSite sites[PROF_SITES];
+static profEvent* events;
+static int eventCount, eventCapacity, siteCount, locking;
+static long droppedEvents;
+static double startTime; //Set after a barrier so every rank's timeline starts together
+static pthread_mutex_t profLock = PTHREAD_MUTEX_INITIALIZER; //Only taken under MPI_THREAD_MULTIPLE
+
+
+static long long typeBytes(int count, MPI_Datatype type) {
+  int size = 0;
+  if(type != MPI_DATATYPE_NULL)
+    PMPI_Type_size(type, &size);
+  return (long long)count * size;
+}
+
+
+static profSite* findSite(int call, void* site, int tag) { //Linear probing, adding the entry if it is new
+  unsigned long slot = ((unsigned long)site * 31 + call * 7 + tag) & (PROF_SITES - 1);
+  while(sites[slot].site && (sites[slot].site != site || sites[slot].call != call || sites[slot].tag != tag))
+    slot = (slot + 1) & (PROF_SITES - 1);
+  if(!sites[slot].site) {
+    if(siteCount >= PROF_SITES - CALLS - 1 && site != OTHER_SITES) //Leaves room for every call's catch all
+      return findSite(call, OTHER_SITES, NO_TAG);
+    sites[slot].site = site;
+    sites[slot].call = call;
+    sites[slot].tag = tag;
+    ++siteCount;
+  }
+  return &sites[slot];
+}
+
+
+static void record(int call, void* site, int tag, long long bytes, double start) { //Accounts one finished call
+  double end = PMPI_Wtime();
+  profSite* entry;
+  if(locking)
+    pthread_mutex_lock(&profLock);
+  entry = findSite(call, site, tag);
+  ++entry->count;
+  entry->bytes += bytes;
+  entry->blocked += end - start;
+  if(eventCount < eventCapacity)
+    events[eventCount++] = (profEvent){start - startTime, end - startTime, call};
+  else
+    ++droppedEvents;
+  if(locking)
+    pthread_mutex_unlock(&profLock);
+}
+
+
+static void siteName(void* site, char* name) { //function+offset, file+offset or the raw address
+  Dl_info info;
+  if(site == OTHER_SITES)
+    snprintf(name, PROF_SITE_NAME, "(other sites)");
+  else if(dladdr(site, &info) && info.dli_sname)
+    snprintf(name, PROF_SITE_NAME, "%s+0x%lx", info.dli_sname, (unsigned long)((char*)site - (char*)info.dli_saddr));
+  else if(dladdr(site, &info) && info.dli_fname)
+    snprintf(name, PROF_SITE_NAME, "%s+0x%lx", strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname, (unsigned long)((char*)site - (char*)info.dli_fbase));
+  else
+    snprintf(name, PROF_SITE_NAME, "%p", site);
+}
+
+
+static void profStart(void) {
+  const char* capacity = getenv("MPIPROF_EVENTS");
+  eventCapacity = capacity ? atoi(capacity) : PROF_DEFAULT_EVENTS;
+  events = malloc((eventCapacity > 0 ? eventCapacity : 1) * sizeof(profEvent));
+  PMPI_Barrier(MPI_COMM_WORLD);
+  startTime = PMPI_Wtime();
+}
+
+
+int MPI_Init(int* argc, char*** argv) {
+  int result = PMPI_Init(argc, argv);
+  profStart();
+  return result;
+}
+
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+  int result = PMPI_Init_thread(argc, argv, required, provided);
+  locking = *provided == MPI_THREAD_MULTIPLE;
+  profStart();
+  return result;
+}
+
+
+static int compareRecords(const void* a, const void* b) { //Rank, then most time blocked first
+  const profRecord *x = a, *y = b;
+  if(x->rank != y->rank)
+    return x->rank - y->rank;
+  return (x->blocked < y->blocked) - (x->blocked > y->blocked);
+}
+
+
+static void writeSummary(FILE* file, int size, const profTotals* totals, profRecord* records, int recordCount) {
+  int i, r;
+  double wall = 0, blocked = 0;
+  long long bytes = 0;
+  long calls = 0;
+  for(r=0;r<size;++r) {
+    wall = totals[r].wall > wall ? totals[r].wall : wall;
+    blocked += totals[r].blocked;
+    bytes += totals[r].bytes;
+    calls += totals[r].calls;
+  }
+  fprintf(file, "%d ranks, %f seconds, %ld MPI calls moving %lld bytes, %.1f%% of rank time in MPI\n\n", size, wall, calls, bytes, wall > 0 ? 100 * blocked / (wall * size) : 0);
+  fprintf(file, "%-6s %12s %12s %12s %8s %10s %14s %8s\n", "rank", "wall s", "mpi s", "compute s", "compute", "calls", "bytes", "dropped");
+  for(r=0;r<size;++r)
+    fprintf(file, "%-6d %12.6f %12.6f %12.6f %7.1f%% %10ld %14lld %8ld\n", r, totals[r].wall, totals[r].blocked, totals[r].wall - totals[r].blocked,
+      totals[r].wall > 0 ? 100 * (totals[r].wall - totals[r].blocked) / totals[r].wall : 0, totals[r].calls, totals[r].bytes, totals[r].droppedEvents);
+  qsort(records, recordCount, sizeof(profRecord), compareRecords);
+  fprintf(file, "\n%-6s %-14s %6s %10s %14s %12s %10s  %s\n", "rank", "call", "tag", "count", "bytes", "blocked s", "mean us", "site");
+  for(i=0;i<recordCount;++i) {
+    char tag[16] = "-";
+    if(records[i].tag == MPI_ANY_TAG)
+      strcpy(tag, "any");
+    else if(records[i].tag != NO_TAG)
+      snprintf(tag, sizeof(tag), "%d", records[i].tag);
+    fprintf(file, "%-6d %-14s %6s %10ld %14lld %12.6f %10.2f  %s\n", records[i].rank, callNames[records[i].call], tag, records[i].count, records[i].bytes,
+      records[i].blocked, 1e6 * records[i].blocked / records[i].count, records[i].site);
+  }
+}
+
+
+static void writeTrace(FILE* file, int size, const profTotals* totals, const profEvent* allEvents) {
+  int r, i, first = 1;
+  double computeFrom;
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  for(r=0;r<size;++r) {
+    fprintf(file, "%s\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"rank %d\"}}", first ? "" : ",", r, r);
+    first = 0;
+    for(computeFrom=0, i=0;i<totals[r].events;++i, ++allEvents) { //Gaps between calls are compute
+      if(allEvents->start > computeFrom)
+        fprintf(file, ",\n{\"name\": \"compute\", \"cat\": \"compute\", \"ph\": \"X\", \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}", r, 1e6 * computeFrom, 1e6 * (allEvents->start - computeFrom));
+      fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"mpi\", \"ph\": \"X\", \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}", callNames[allEvents->call], r, 1e6 * allEvents->start, 1e6 * (allEvents->end - allEvents->start));
+      computeFrom = allEvents->end;
+    }
+  }
+  fprintf(file, "\n]}\n");
+}
+
+
+int MPI_Finalize(void) {
+  int i, r, rank, size, recordCount = 0, eventTotal = 0, *counts = NULL, *displs = NULL;
+  const char* prefix = getenv("MPIPROF_PREFIX") ? getenv("MPIPROF_PREFIX") : "mpiprof";
+  char name[1024];
+  profTotals mine = {PMPI_Wtime() - startTime, 0, 0, droppedEvents, 0, 0, eventCount}, *totals = NULL;
+  profRecord* records = calloc(siteCount + 1, sizeof(profRecord)), *allRecords = NULL;
+  profEvent* allEvents = NULL;
+  MPI_Datatype recordType, eventType; //Counts go in whole records and events, in bytes they overflow an int from a few hundred ranks
+  FILE *summary, *trace;
+
+  PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  PMPI_Comm_size(MPI_COMM_WORLD, &size);
+  for(i=0;i<PROF_SITES;++i)
+    if(sites[i].site) {
+      records[mine.sites] = (profRecord){rank, sites[i].call, sites[i].tag, sites[i].count, sites[i].bytes, sites[i].blocked, ""};
+      siteName(sites[i].site, records[mine.sites].site);
+      mine.blocked += sites[i].blocked;
+      mine.calls += sites[i].count;
+      mine.bytes += sites[i].bytes;
+      ++mine.sites;
+    }
+
+  if(rank == 0) {
+    totals = malloc(size * sizeof(profTotals));
+    counts = malloc(size * sizeof(int));
+    displs = malloc(size * sizeof(int));
+  }
+  PMPI_Gather(&mine, sizeof(profTotals), MPI_BYTE, totals, sizeof(profTotals), MPI_BYTE, 0, MPI_COMM_WORLD);
+  PMPI_Type_contiguous(sizeof(profRecord), MPI_BYTE, &recordType);
+  PMPI_Type_commit(&recordType);
+  PMPI_Type_contiguous(sizeof(profEvent), MPI_BYTE, &eventType);
+  PMPI_Type_commit(&eventType);
+  if(rank == 0) { //Sites, then the timelines, each rank's packed after the last
+    for(r=0;r<size;++r) {
+      counts[r] = totals[r].sites;
+      displs[r] = recordCount;
+      recordCount += totals[r].sites;
+    }
+    allRecords = malloc((recordCount + 1) * sizeof(profRecord));
+  }
+  PMPI_Gatherv(records, mine.sites, recordType, allRecords, counts, displs, recordType, 0, MPI_COMM_WORLD);
+  if(rank == 0) {
+    for(r=0;r<size;++r) {
+      counts[r] = totals[r].events;
+      displs[r] = eventTotal;
+      eventTotal += totals[r].events;
+    }
+    allEvents = malloc((eventTotal + 1) * sizeof(profEvent));
+  }
+  PMPI_Gatherv(events, eventCount, eventType, allEvents, counts, displs, eventType, 0, MPI_COMM_WORLD);
+  PMPI_Type_free(&recordType);
+  PMPI_Type_free(&eventType);
+
+  if(rank == 0) {
+    snprintf(name, sizeof(name), "%s.txt", prefix);
+    summary = fopen(name, "w");
+    snprintf(name, sizeof(name), "%s.json", prefix);
+    trace = fopen(name, "w");
+    if(summary && trace) {
+      writeSummary(summary, size, totals, allRecords, recordCount);
+      writeTrace(trace, size, totals, allEvents);
+      fprintf(stderr, "mpiprof: summary in %s.txt, trace in %s.json\n", prefix, prefix);
+    }
+    else
+      fprintf(stderr, "mpiprof: cannot write %s.txt and %s.json\n", prefix, prefix);
+    if(summary)
+      fclose(summary);
+    if(trace)
+      fclose(trace);
+  }
+  free(records);
+  free(allRecords);
+  free(allEvents);
+  free(events);
+  free(totals);
+  free(counts);
+  free(displs);
+  return PMPI_Finalize();
+}
+
+
+//The wrappers, each times the real call and accounts it to the code that made it
+
+#define SITE __builtin_return_address(0)
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Send(buf, count, type, dest, tag, comm);
+  record(CALL_SEND, SITE, tag, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status* status) {
+  double start = PMPI_Wtime();
+  MPI_Status local;
+  int received = 0, result = PMPI_Recv(buf, count, type, source, tag, comm, status == MPI_STATUS_IGNORE ? &local : status);
+  PMPI_Get_count(status == MPI_STATUS_IGNORE ? &local : status, type, &received); //What arrived rather than the buffer size
+  record(CALL_RECV, SITE, tag, typeBytes(received == MPI_UNDEFINED ? count : received, type), start);
+  return result;
+}
+
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* request) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+  record(CALL_ISEND, SITE, tag, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request* request) { //Bytes are the buffer size
+  double start = PMPI_Wtime();
+  int result = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+  record(CALL_IRECV, SITE, tag, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Bcast(buf, count, type, root, comm);
+  record(CALL_BCAST, SITE, NO_TAG, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Ibcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm, MPI_Request* request) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Ibcast(buf, count, type, root, comm, request);
+  record(CALL_IBCAST, SITE, NO_TAG, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Reduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+  record(CALL_REDUCE, SITE, NO_TAG, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+  record(CALL_ALLREDUCE, SITE, NO_TAG, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Iallreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm, MPI_Request* request) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Iallreduce(sendbuf, recvbuf, count, type, op, comm, request);
+  record(CALL_IALLREDUCE, SITE, NO_TAG, typeBytes(count, type), start);
+  return result;
+}
+
+
+int MPI_Gather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int rank, size, result = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+  PMPI_Comm_rank(comm, &rank);
+  PMPI_Comm_size(comm, &size);
+  record(CALL_GATHER, SITE, NO_TAG, rank == root ? typeBytes(recvcount, recvtype) * size : typeBytes(sendcount, sendtype), start);
+  return result;
+}
+
+
+int MPI_Gatherv(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int i, rank, size, result = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm);
+  long long bytes = 0;
+  PMPI_Comm_rank(comm, &rank);
+  PMPI_Comm_size(comm, &size);
+  if(rank == root)
+    for(i=0;i<size;++i)
+      bytes += typeBytes(recvcounts[i], recvtype);
+  else
+    bytes = typeBytes(sendcount, sendtype);
+  record(CALL_GATHERV, SITE, NO_TAG, bytes, start);
+  return result;
+}
+
+
+int MPI_Scatterv(const void* sendbuf, const int sendcounts[], const int displs[], MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int i, rank, size, result = PMPI_Scatterv(sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm);
+  long long bytes = 0;
+  PMPI_Comm_rank(comm, &rank);
+  PMPI_Comm_size(comm, &size);
+  if(rank == root)
+    for(i=0;i<size;++i)
+      bytes += typeBytes(sendcounts[i], sendtype);
+  else
+    bytes = typeBytes(recvcount, recvtype);
+  record(CALL_SCATTERV, SITE, NO_TAG, bytes, start);
+  return result;
+}
+
+
+int MPI_Alltoall(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int size, result = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+  PMPI_Comm_size(comm, &size);
+  record(CALL_ALLTOALL, SITE, NO_TAG, typeBytes(sendcount, sendtype) * size, start);
+  return result;
+}
+
+
+int MPI_Barrier(MPI_Comm comm) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Barrier(comm);
+  record(CALL_BARRIER, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Ibarrier(MPI_Comm comm, MPI_Request* request) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Ibarrier(comm, request);
+  record(CALL_IBARRIER, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Wait(request, status);
+  record(CALL_WAIT, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Waitany(int count, MPI_Request requests[], int* index, MPI_Status* status) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Waitany(count, requests, index, status);
+  record(CALL_WAITANY, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Waitall(count, requests, statuses);
+  record(CALL_WAITALL, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Waitsome(int incount, MPI_Request requests[], int* outcount, int indices[], MPI_Status statuses[]) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Waitsome(incount, requests, outcount, indices, statuses);
+  record(CALL_WAITSOME, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Test(MPI_Request* request, int* flag, MPI_Status* status) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Test(request, flag, status);
+  record(CALL_TEST, SITE, NO_TAG, 0, start);
+  return result;
+}
+
+
+int MPI_Iprobe(int source, int tag, MPI_Comm comm, int* flag, MPI_Status* status) {
+  double start = PMPI_Wtime();
+  int result = PMPI_Iprobe(source, tag, comm, flag, status);
+  record(CALL_IPROBE, SITE, tag, 0, start);
+  return result;
+}
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "mpi.h"
+#include "integrator.h"
+
+//Energy error against wall time for every integrator. Each scheme runs a bound cluster to the same end time
+//at every step size, from the same start, through the same distributed force sweeps nbody uses. The cluster
+//is a sphere of bodies given random velocities scaled to virial equilibrium, so it keeps moving on its own
+//crossing time rather than drifting apart. The energy is checked at -checks points and at the end, outside
+//the timing. Prints every run, then for each decade of error the cheapest run that stayed within it;
+//-o prefix also writes the runs to prefix.csv.
+//Usage: mpirun -np N bench_integrators [-bodies n] [-time t] [-dts list] [-schemes list] [-softening s] [-checks n] [-seed s] [-o prefix]
+//Lists are comma separated.
+
+#define BENCH_BODIES 100
+#define BENCH_TIME 20.0
+#define BENCH_SOFTENING 5.0
+#define BENCH_CHECKS 20
+#define CLUSTER_RADIUS 500.0
+#define MAX_SWEEP 32 //Longest list for any one sweep
+
+typedef struct {
+  const integrator *scheme;
+  double dt, seconds, maxError, finalError;
+  long steps, sweeps;
+} benchRun;
+
+
+void init_cluster(bodystore *b, double softening, unsigned seed) {
+  double kinetic = 0, potential, scale;
+  int i, c;
+  srand(seed);
+  for(i=0;i<b->count;i++) {
+    double p[3], r2;
+    do { //Uniform in the sphere
+      r2 = 0;
+      for(c=0;c<3;c++) {
+        p[c] = (2.0 * rand() / RAND_MAX - 1) * CLUSTER_RADIUS;
+        r2 += p[c] * p[c];
+      }
+    } while(r2 > CLUSTER_RADIUS * CLUSTER_RADIUS);
+    b->field[MASS][i] = rand()%1000 + 100;
+    for(c=0;c<3;c++) {
+      b->field[XPOS + c][i] = p[c];
+      b->field[XVEL + c][i] = 2.0 * rand() / RAND_MAX - 1;
+    }
+  }
+  for(i=0;i<b->count;i++)
+    for(c=0;c<3;c++)
+      kinetic += 0.5 * b->field[MASS][i] * pow(b->field[XVEL + c][i], 2);
+  potential = total_energy(b, softening) - kinetic;
+  scale = sqrt(-0.5 * potential / kinetic); //Twice the kinetic energy balances the potential
+  for(i=0;i<b->count;i++)
+    for(c=0;c<3;c++)
+      b->field[XVEL + c][i] *= scale;
+}
+
+
+int parse_list(char *str, double *values) { //Comma separated positive numbers, how many or 0 if malformed
+  int count = 0;
+  char *p;
+  for(p=strtok(str, ",");p && count<MAX_SWEEP;p=strtok(NULL, ","))
+    if((values[count++] = atof(p)) <= 0)
+      return 0;
+  return p ? 0 : count;
+}
+
+
+int compare_cost(const void *a, const void *b) {
+  const benchRun *x = a, *y = b;
+  return (x->seconds > y->seconds) - (x->seconds < y->seconds);
+}
+
+
+int main(int argc, char* argv[]) {
+  int i, j, s, d, rank, size, count = BENCH_BODIES, checks = BENCH_CHECKS, dtCount = 5, schemeCount = INTEGRATORS, runCount = 0, ok = 1;
+  double endTime = BENCH_TIME, softening = BENCH_SOFTENING, dts[MAX_SWEEP] = {1, 0.5, 0.25, 0.125, 0.0625}, energy = 0, error, target;
+  unsigned seed = 1;
+  const integrator *schemes[MAX_SWEEP];
+  const char *prefix = NULL;
+  double (*acc)[3];
+  bodystore start, bodies;
+  benchRun *runs;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  for(i=0;i<INTEGRATORS;i++)
+    schemes[i] = &integrators[i];
+  for(i=1;i<argc && ok;i++) {
+    if(strcmp(argv[i], "-bodies") == 0 && i + 1 < argc)
+      ok = (count = atoi(argv[++i])) > 1;
+    else if(strcmp(argv[i], "-time") == 0 && i + 1 < argc)
+      ok = (endTime = atof(argv[++i])) > 0;
+    else if(strcmp(argv[i], "-dts") == 0 && i + 1 < argc)
+      ok = (dtCount = parse_list(argv[++i], dts)) > 0;
+    else if(strcmp(argv[i], "-schemes") == 0 && i + 1 < argc) {
+      char *p;
+      for(schemeCount=0, p=strtok(argv[++i], ",");p && ok;p=strtok(NULL, ","))
+        ok = schemeCount < MAX_SWEEP && (schemes[schemeCount++] = find_integrator(p)) != NULL;
+    }
+    else if(strcmp(argv[i], "-softening") == 0 && i + 1 < argc)
+      ok = (softening = atof(argv[++i])) >= 0;
+    else if(strcmp(argv[i], "-checks") == 0 && i + 1 < argc)
+      ok = (checks = atoi(argv[++i])) > 0;
+    else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      prefix = argv[++i];
+    else
+      ok = 0;
+  }
+  if(!ok || schemeCount == 0) {
+    if(rank == 0)
+      fprintf(stderr, "Usage: %s [-bodies n] [-time t] [-dts list] [-schemes list] [-softening s] [-checks n] [-seed s] [-o prefix]\n", argv[0]);
+    MPI_Finalize();
+    return 1;
+  }
+
+  store_alloc(&start, count);
+  store_alloc(&bodies, count);
+  acc = malloc(count * sizeof(*acc));
+  runs = malloc(schemeCount * dtCount * sizeof(benchRun));
+  if(rank == 0) {
+    double mass = 0;
+    init_cluster(&start, softening, seed);
+    for(i=0;i<count;i++)
+      mass += start.field[MASS][i];
+    printf("%d bodies to time %g, crossing time %g, %d ranks\n\n", count, endTime, CLUSTER_RADIUS / sqrt(-2 * total_energy(&start, softening) / mass), size); //The kinetic energy is minus the total
+    printf("%-10s %10s %8s %8s %12s %14s %14s\n", "scheme", "dt", "steps", "sweeps", "seconds", "max |dE/E|", "final |dE/E|");
+  }
+
+  for(s=0;s<schemeCount;s++)
+    for(d=0;d<dtCount;d++) {
+      benchRun *run = &runs[runCount++];
+      long step, nextCheck;
+      double mark;
+      memcpy(bodies.block, start.block, (size_t)count * BODY_DATA_COLS * sizeof(double));
+      run->scheme = schemes[s];
+      run->dt = dts[d];
+      run->steps = (long)ceil(endTime / dts[d] - 1e-9);
+      run->sweeps = 1 + run->steps * schemes[s]->stages;
+      run->seconds = run->maxError = 0;
+      if(rank == 0)
+        energy = total_energy(&bodies, softening);
+
+      MPI_Barrier(MPI_COMM_WORLD);
+      mark = MPI_Wtime();
+      force_sweep(&bodies, acc, softening, rank, size, NULL);
+      for(step=1, nextCheck=1;step<=run->steps;step++) {
+        integrate_step(schemes[s], &bodies, acc, dts[d], softening, rank, size, NULL);
+        if(step == run->steps || step * checks >= nextCheck * run->steps) { //Checks are spread evenly, off the clock
+          run->seconds += MPI_Wtime() - mark;
+          if(rank == 0) {
+            error = fabs((total_energy(&bodies, softening) - energy) / energy);
+            if(error > run->maxError || isnan(error))
+              run->maxError = error;
+            run->finalError = error;
+          }
+          nextCheck++;
+          MPI_Barrier(MPI_COMM_WORLD);
+          mark = MPI_Wtime();
+        }
+      }
+      if(rank == 0)
+        printf("%-10s %10g %8ld %8ld %12f %14.3e %14.3e\n", run->scheme->name, run->dt, run->steps, run->sweeps, run->seconds, run->maxError, run->finalError);
+    }
+
+  if(rank == 0) {
+    if(prefix) {
+      char name[1024];
+      FILE *out;
+      snprintf(name, sizeof(name), "%s.csv", prefix);
+      if((out = fopen(name, "w")) == NULL)
+        fprintf(stderr, "Could not write %s\n", name);
+      else {
+        fprintf(out, "scheme,order,dt,steps,sweeps,seconds,max_error,final_error\n");
+        for(j=0;j<runCount;j++)
+          fprintf(out, "%s,%d,%g,%ld,%ld,%f,%e,%e\n", runs[j].scheme->name, runs[j].scheme->order, runs[j].dt, runs[j].steps, runs[j].sweeps, runs[j].seconds, runs[j].maxError, runs[j].finalError);
+        fclose(out);
+      }
+    }
+    qsort(runs, runCount, sizeof(benchRun), compare_cost); //The csv keeps run order
+    printf("\nCheapest run within each error\n");
+    for(target=1e-1;target>=1e-13;target/=10) {
+      for(j=0;j<runCount && !(runs[j].maxError <= target);j++);
+      if(j == runCount)
+        break;
+      printf("  %8.0e  %-10s dt %-8g %f seconds\n", target, runs[j].scheme->name, runs[j].dt, runs[j].seconds);
+    }
+  }
+  store_close(&start);
+  store_close(&bodies);
+  free(acc);
+  free(runs);
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef BODYSTORE_H
+#define BODYSTORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Bodies as one array per field, mass, x, y, z, vx, vy, vz, one after another in a single block so the whole
+//state is one broadcast. A store can live in a file: a page of header, then the block, mapped shared so the
+//master integrates straight into the file and a later run starts from it without reading anything in.
+//Other processes can map a live file read-only. The header's sequence is odd while the master is changing
+//the bodies, so a reader copies the block and keeps the copy only if the sequence was the same even
+//number before and after. The master only writes between force sweeps, so the file is readable for most of
+//a step, but then part way through it: stage says which of the step's sweeps is running, 0 at the end of one.
+//A file left odd or part way through a step by a run that died can still be read but is not opened for writing.
+
+#define BODY_DATA_COLS 7
+
+#define MASS 0
+#define XPOS 1
+#define YPOS 2
+#define ZPOS 3
+#define XVEL 4
+#define YVEL 5
+#define ZVEL 6
+
+#define STORE_MAGIC "NBSTORE1"
+#define STORE_HEADER_BYTES 4096 //The arrays start a page into the file
+
+typedef struct { //On-disk header, padded to STORE_HEADER_BYTES
+  char magic[8];
+  int64_t count, step; //Bodies, and steps finished over every run on the file
+  double time; //Simulated time at the end of the last finished step
+  int64_t sequence; //Odd while the bodies are being changed
+  int64_t stage; //Sweeps done in the step under way, 0 between steps
+} storeheader;
+
+typedef struct {
+  int count;
+  double *field[BODY_DATA_COLS]; //field[XPOS][i] is body i's x and so on
+  double *block; //Every field, count doubles each
+  storeheader *header; //The mapped file's header, NULL for bodies only in memory
+  size_t bytes; //Mapped
+} bodystore;
+
+static inline void store_fields(bodystore *b, double *block, int count) {
+  int c;
+  b->count = count;
+  b->block = block;
+  for(c=0;c<BODY_DATA_COLS;c++)
+    b->field[c] = block + (size_t)c * count;
+}
+
+static inline int store_alloc(bodystore *b, int count) { //Bodies in private memory, returns 0 if there is not enough
+  double *block = calloc((size_t)count * BODY_DATA_COLS, sizeof(double));
+  store_fields(b, block, count);
+  b->header = NULL;
+  b->bytes = 0;
+  return block != NULL;
+}
+
+static inline int store_map(bodystore *b, int fd, size_t bytes, int writable) {
+  void *map = mmap(NULL, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); //The mapping keeps the file
+  if(map == MAP_FAILED)
+    return 0;
+  b->header = map;
+  b->bytes = bytes;
+  store_fields(b, (double *)((char *)map + STORE_HEADER_BYTES), (int)b->header->count);
+  return 1;
+}
+
+static inline int store_create(bodystore *b, const char *path, int count) { //A new file of count zeroed bodies, marked busy until store_end
+  size_t bytes = STORE_HEADER_BYTES + (size_t)count * BODY_DATA_COLS * sizeof(double);
+  storeheader header = {STORE_MAGIC, count, 0, 0, 1, 0};
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return 0;
+  if(ftruncate(fd, bytes) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    close(fd);
+    return 0;
+  }
+  return store_map(b, fd, bytes, 1);
+}
+
+static inline int store_open(bodystore *b, const char *path, int writable) {
+  //An existing file, returns 0 if it is not a whole store and -1 if it is to be written but was left part way
+  //through a step, its run died while the master was changing the bodies or between the sweeps of a step
+  storeheader header;
+  struct stat st;
+  int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if(fd < 0)
+    return 0;
+  if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, STORE_MAGIC, 8) != 0 || header.count < 1 || header.count > INT32_MAX / BODY_DATA_COLS
+      || fstat(fd, &st) != 0 || (size_t)st.st_size < STORE_HEADER_BYTES + (size_t)header.count * BODY_DATA_COLS * sizeof(double)) {
+    close(fd);
+    return 0;
+  }
+  if(writable && ((header.sequence & 1) || header.stage != 0)) { //Its bodies are not all from one time, readers can still look
+    close(fd);
+    return -1;
+  }
+  return store_map(b, fd, STORE_HEADER_BYTES + (size_t)header.count * BODY_DATA_COLS * sizeof(double), writable);
+}
+
+static inline void store_begin(bodystore *b) { //The bodies are about to change
+  if(b->header) {
+    __atomic_store_n(&b->header->sequence, b->header->sequence | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); //No write to the bodies is seen before the odd sequence
+  }
+}
+
+static inline void store_end(bodystore *b, int stage, long steps, double time) { //They have, stage sweeps into a step or steps more steps and time more time on
+  if(b->header) {
+    b->header->stage = stage;
+    b->header->step += steps;
+    b->header->time += time;
+    __atomic_store_n(&b->header->sequence, b->header->sequence + 1, __ATOMIC_RELEASE);
+  }
+}
+
+static inline int store_snapshot(const bodystore *live, bodystore *copy, storeheader *header, double wait) {
+  //Copies a consistent state of a store another process is changing into copy, allocated to match
+  //returns 0 if the writer is still mid step after wait seconds, steps of a big run can take minutes
+  struct timespec pause = {0, 1000000}, start, now;
+  int64_t before;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while(1) {
+    before = __atomic_load_n(&live->header->sequence, __ATOMIC_ACQUIRE);
+    if(!(before & 1)) {
+      memcpy(header, live->header, sizeof(storeheader));
+      memcpy(copy->block, live->block, (size_t)live->count * BODY_DATA_COLS * sizeof(double));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if(__atomic_load_n(&live->header->sequence, __ATOMIC_RELAXED) == before)
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec - start.tv_sec + (now.tv_nsec - start.tv_nsec) * 1e-9 >= wait)
+      return 0;
+    nanosleep(&pause, NULL);
+  }
+}
+
+static inline void store_close(bodystore *b) { //Flushes a mapped file
+  if(b->header) {
+    msync(b->header, b->bytes, MS_SYNC);
+    munmap(b->header, b->bytes);
+  }
+  else
+    free(b->block);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "mpi.h"
+
+//In-situ rendering of the bodies instead of text dumps. Every rank splats the bodies it computed into its own
+//copy of a density image, the x-y plane seen from above, spreading each body's mass over the four nearest
+//pixels. The copies are summed onto rank 0 with one MPI_Reduce, which colours the log of the mass density
+//and writes a binary PPM. A frame costs the same however many bodies there are, one image sized reduce.
+
+#define FRAME_DEFAULT_SIZE 512
+#define FRAME_SATURATION 8.0 //Pixels holding this many of the heaviest bodies' mass are full brightness
+
+typedef struct {
+  int width, height;
+  double x0, y0, scale; //Simulation coordinates of the image's bottom left corner, pixels per unit
+  double saturation; //Mass per pixel that maps to the top of the colour ramp
+  float *density, *total; //This rank's splats, and the sum on rank 0
+  unsigned char *rgb;
+  int count; //Frames written so far
+} frame;
+
+void frame_init(frame *f, int width, int height, double centreX, double centreY, double span, double maxMass, int rank) { //span is the width shown, in simulation units
+  f->width = width;
+  f->height = height;
+  f->scale = width / span;
+  f->x0 = centreX - span / 2;
+  f->y0 = centreY - height / f->scale / 2;
+  f->saturation = FRAME_SATURATION * maxMass;
+  f->density = calloc((size_t)width * height, sizeof(float));
+  f->total = rank == 0 ? malloc((size_t)width * height * sizeof(float)) : NULL;
+  f->rgb = rank == 0 ? malloc((size_t)width * height * 3) : NULL;
+  f->count = 0;
+}
+
+void frame_splat(frame *f, double x, double y, double mass) { //Cloud in cell, mass off the image is dropped
+  double px = (x - f->x0) * f->scale - 0.5, py = (y - f->y0) * f->scale - 0.5, fx, fy;
+  int ix = (int)floor(px), iy = (int)floor(py), dx, dy;
+  if(ix < -1 || iy < -1 || ix >= f->width || iy >= f->height)
+    return;
+  fx = px - ix;
+  fy = py - iy;
+  for(dy=0;dy<2;dy++)
+    for(dx=0;dx<2;dx++)
+      if(ix + dx >= 0 && ix + dx < f->width && iy + dy >= 0 && iy + dy < f->height)
+        f->density[(size_t)(f->height - 1 - iy - dy) * f->width + ix + dx] += mass * (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy); //Row 0 is the top
+}
+
+static void frame_colour(double t, unsigned char *rgb) { //Black through red and orange to white
+  static const double stops[5][3] = {{0, 0, 0}, {0.35, 0.05, 0.35}, {0.85, 0.2, 0.1}, {1, 0.7, 0.2}, {1, 1, 1}};
+  int i = (int)(t * 4), c;
+  if(i >= 4)
+    i = 3;
+  t = t * 4 - i;
+  for(c=0;c<3;c++)
+    rgb[c] = (unsigned char)(255 * (stops[i][c] + (stops[i+1][c] - stops[i][c]) * t) + 0.5);
+}
+
+int frame_write(frame *f, const char *prefix, int rank, MPI_Comm comm) { //Sums every rank's splats, rank 0 writes prefix_NNNNN.ppm, returns 0 if it could not
+  size_t i, pixels = (size_t)f->width * f->height;
+  int written = 1;
+  MPI_Reduce(f->density, f->total, pixels, MPI_FLOAT, MPI_SUM, 0, comm);
+  memset(f->density, 0, pixels * sizeof(float));
+  if(rank == 0) {
+    char name[1024];
+    double top = log1p(f->saturation);
+    FILE *out;
+    for(i=0;i<pixels;i++) {
+      double t = log1p(f->total[i]) / top;
+      frame_colour(t > 1 ? 1 : t, f->rgb + i * 3);
+    }
+    snprintf(name, sizeof(name), "%s_%05d.ppm", prefix, f->count);
+    out = fopen(name, "wb");
+    if(out) {
+      fprintf(out, "P6\n%d %d\n255\n", f->width, f->height);
+      written = fwrite(f->rgb, 3, pixels, out) == pixels;
+      fclose(out);
+    }
+    else
+      written = 0;
+  }
+  f->count++;
+  return written;
+}
+
+void frame_free(frame *f) {
+  free(f->density);
+  free(f->total);
+  free(f->rgb);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mpi.h"
+#include "frame.h"
+#include "bodystore.h"
+
+//Integrators as a list of kicks and drifts. A step of dt is, for every stage s, a kick of the velocities by
+//kick[s] * dt times the accelerations and a drift of the positions by drift[s] * dt times the velocities,
+//then a closing kick of kick[stages] * dt. The accelerations are swept after every drift, so the ones the
+//closing kick uses are still right for the next step's first kick and a step costs one sweep per stage.
+//Only the sweeps are shared out. The master keeps every body and does the O(N) kicks and drifts, and hands
+//bodies to the nodes, which send back each one's acceleration from the O(N^2) sum over the others.
+
+#define MAX_STAGES 4
+
+const double GRAV_CONST = 1;
+
+typedef struct {
+  const char *name;
+  int stages, order;
+  double kick[MAX_STAGES + 1], drift[MAX_STAGES];
+} integrator;
+
+static const integrator integrators[] = {
+  {"euler", 1, 1, {1, 0}, {1}}, //Kick with the old accelerations then drift, first order and the default
+  {"leapfrog", 1, 2, {0.5, 0.5}, {1}}, //Kick-drift-kick, no dearer than euler
+  {"yoshida4", 3, 4, {0.6756035959798289, -0.1756035959798288, -0.1756035959798288, 0.6756035959798289},
+    {1.3512071919596578, -1.7024143839193153, 1.3512071919596578}}, //Three leapfrogs of w1, w0, w1 (Forest-Ruth)
+};
+#define INTEGRATORS (int)(sizeof(integrators) / sizeof(integrators[0]))
+
+const integrator *find_integrator(const char *name) { //NULL if there is no such scheme
+  int i;
+  for(i=0;i<INTEGRATORS;i++)
+    if(strcmp(integrators[i].name, name) == 0)
+      return &integrators[i];
+  return NULL;
+}
+
+void body_acceleration(const bodystore *b, int body, double softening, double acc[3]) { //Pull of every other body, softening keeps close passes finite
+  const double *mass = b->field[MASS], *x = b->field[XPOS], *y = b->field[YPOS], *z = b->field[ZPOS];
+  double fx, fy, fz, r;
+  int i;
+  acc[0] = acc[1] = acc[2] = 0;
+  for(i=0;i<b->count;i++) {
+    if(i==body)
+      continue;
+    r = sqrt((pow(x[i] - x[body], 2) + pow(y[i] - y[body], 2) + pow(z[i] - z[body], 2) + pow(softening, 2)));
+    fx = ((GRAV_CONST * mass[i] * mass[body]) / (pow(r, 2))) * ((x[i] - x[body]) / r);
+    fy = ((GRAV_CONST * mass[i] * mass[body]) / (pow(r, 2))) * ((y[i] - y[body]) / r);
+    fz = ((GRAV_CONST * mass[i] * mass[body]) / (pow(r, 2))) * ((z[i] - z[body]) / r);
+    acc[0] += fx / mass[body];
+    acc[1] += fy / mass[body];
+    acc[2] += fz / mass[body];
+  }
+}
+
+double total_energy(const bodystore *b, double softening) { //Kinetic plus potential
+  const double *mass = b->field[MASS], *x = b->field[XPOS], *y = b->field[YPOS], *z = b->field[ZPOS];
+  double energy = 0, r;
+  int i, j;
+  for(i=0;i<b->count;i++) {
+    energy += 0.5 * mass[i] * (pow(b->field[XVEL][i], 2) + pow(b->field[YVEL][i], 2) + pow(b->field[ZVEL][i], 2));
+    for(j=i+1;j<b->count;j++) {
+      r = sqrt(pow(x[i] - x[j], 2) + pow(y[i] - y[j], 2) + pow(z[i] - z[j], 2) + pow(softening, 2));
+      energy -= GRAV_CONST * mass[i] * mass[j] / r;
+    }
+  }
+  return energy;
+}
+
+void force_sweep(bodystore *b, double acc[][3], double softening, int rank, int worldSize, frame *view) {
+  //Every rank calls it with a store of the same size, the master ends up with the accelerations at its positions in acc
+  //Nodes draw the bodies they are given into view when it is set
+  int i, newBody;
+
+  MPI_Bcast(b->block, b->count * BODY_DATA_COLS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if(worldSize == 1) { //Nobody to share with
+    for(i=0;i<b->count;i++) {
+      body_acceleration(b, i, softening, acc[i]);
+      if(view)
+        frame_splat(view, b->field[XPOS][i], b->field[YPOS][i], b->field[MASS][i]);
+    }
+  }
+
+  else if(rank==0) {
+    MPI_Status stat;
+    int highestBody = 0, exitCondition = b->count + worldSize - 1;
+    newBody = -1;
+
+    while(highestBody < exitCondition) {
+      MPI_Recv(&newBody, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &stat); //Check if that node has already computed a body
+      if(newBody >= 0) {
+        MPI_Recv(acc[newBody], 3, MPI_DOUBLE, stat.MPI_SOURCE, 0, MPI_COMM_WORLD, &stat); //Receive its acceleration
+      }
+      MPI_Send(&highestBody, 1, MPI_INT, stat.MPI_SOURCE, 0, MPI_COMM_WORLD); //Send the node the new body to compute
+      highestBody++;
+    }
+  } //End master node operations
+
+  else {
+    double bodyAcc[3] = {0};
+    newBody = -1;
+
+    while(1) {
+      MPI_Send(&newBody, 1, MPI_INT, 0, 0, MPI_COMM_WORLD); //Send the master node the number of the body that has been computed (will be -1 on first attempt)
+      if(newBody >= 0)
+        MPI_Send(bodyAcc, 3, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD); //Send the acceleration
+      MPI_Recv(&newBody, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE); //Receive the new body to compute
+      if(newBody >= b->count)
+        break;
+      body_acceleration(b, newBody, softening, bodyAcc);
+      if(view) //Each node draws the bodies it computed
+        frame_splat(view, b->field[XPOS][newBody], b->field[YPOS][newBody], b->field[MASS][newBody]);
+    }
+  } //End slave node operations
+}
+
+void integrate_step(const integrator *scheme, bodystore *b, double acc[][3], double dt, double softening, int rank, int worldSize, frame *view) {
+  //Every rank calls it, acc must hold the accelerations at the master's positions and does again afterwards
+  //The master's bodies change in place, marked busy in a file only while it writes, view gets them where the step leaves them
+  int i, c, s;
+  for(s=0;s<scheme->stages;s++) {
+    if(rank == 0) {
+      store_begin(b);
+      for(c=0;c<3;c++)
+        for(i=0;i<b->count;i++) {
+          b->field[XVEL + c][i] += acc[i][c] * scheme->kick[s] * dt;
+          b->field[XPOS + c][i] += b->field[XVEL + c][i] * scheme->drift[s] * dt;
+        }
+      store_end(b, s + 1, 0, 0);
+    }
+    force_sweep(b, acc, softening, rank, worldSize, s == scheme->stages - 1 ? view : NULL);
+  }
+  if(rank == 0) {
+    store_begin(b);
+    if(scheme->kick[scheme->stages] != 0)
+      for(c=0;c<3;c++)
+        for(i=0;i<b->count;i++)
+          b->field[XVEL + c][i] += acc[i][c] * scheme->kick[scheme->stages] * dt;
+    store_end(b, 0, 1, dt);
+  }
+}
+
+#endif
@@ -1,172 +1,219 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
 #include "mpi.h"
+#include "frame.h"
+#include "trajectory.h"
+#include "integrator.h"
 
-#define NUM_BODY 100
+#define NUM_BODY 100 //Unless -bodies or a file says otherwise
 #define ITERATIONS 100
-#define BODY_DATA_COLS 7
-
-#define MASS 0
-#define XPOS 1
-#define YPOS 2
-#define ZPOS 3
-#define XVEL 4
-#define YVEL 5
-#define ZVEL 6
+#define ENERGY_CHECK_BODIES 20000 //Above this the O(N^2) energy check would cost more than a short run
 
 #define TIMESTEP 0.005
 #define MAX_MASS 1000
 #define SPACE_SIZE 1000
 #define BODY_VEL_START 200
 
-const double GRAV_CONST = 1;
-
-void print_data(double bodyData[][BODY_DATA_COLS]) {
+void print_data(const bodystore *b) {
   int i, j;
-  for(i=0;i<NUM_BODY;i++) {
+  for(i=0;i<b->count;i++) {
     printf("[%d]\t", i+1);
     for(j=0;j<BODY_DATA_COLS;j++) {
-      if(j == 0) printf("%-6.0f", bodyData[i][j]);
-      else printf("%-16.4f", bodyData[i][j]);
+      if(j == 0) printf("%-6.0f", b->field[j][i]);
+      else printf("%-16.4f", b->field[j][i]);
     }
     printf("\n");
   }
   printf("\n");
 }
 
-void init_bodies(double bodyData[][BODY_DATA_COLS], int rank, int worldSize) {
-  int i, low, high, remaining, work, dataSize, nodes = worldSize - 1;
+void init_bodies(bodystore *b, int rank, int worldSize) { //Every rank makes an even share of the bodies and the master gathers them
+  int i, c, low = (long)b->count * rank / worldSize, high = (long)b->count * (rank + 1) / worldSize;
+  int *counts = malloc(worldSize * sizeof(int)), *displs = malloc(worldSize * sizeof(int));
   srand((time(NULL) >> rank));
 
-  work = NUM_BODY / (worldSize - 1);
-  dataSize = BODY_DATA_COLS * work;
-  if(rank == 0) {
-    MPI_Status stat;
-    remaining = NUM_BODY % worldSize;
-
-    if(remaining != 0) {
-      low = NUM_BODY - remaining;
-      for(i=low;i<NUM_BODY;i++) {
-        bodyData[i][MASS] = rand()%MAX_MASS + 100;
-        bodyData[i][XPOS] = rand()%SPACE_SIZE;
-        bodyData[i][YPOS] = rand()%SPACE_SIZE;
-        bodyData[i][ZPOS] = rand()%SPACE_SIZE;
-        bodyData[i][XVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-        bodyData[i][YVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-        bodyData[i][ZVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-      }
-    }
-    for(i=0;i<nodes;i++) {
-      MPI_Recv(&low, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &stat);
-      if(stat.MPI_SOURCE!=1) MPI_Recv(&bodyData[low], dataSize, MPI_DOUBLE, stat.MPI_SOURCE, 0, MPI_COMM_WORLD, &stat);
-      else MPI_Recv(&bodyData[low], dataSize << 1, MPI_DOUBLE, stat.MPI_SOURCE, 0, MPI_COMM_WORLD, &stat);
-    }
-    printf("Intial state\n");
-    print_data(bodyData);
+  for(i=low;i<high;i++) {
+    b->field[MASS][i] = rand()%MAX_MASS + 100;
+    b->field[XPOS][i] = rand()%SPACE_SIZE;
+    b->field[YPOS][i] = rand()%SPACE_SIZE;
+    b->field[ZPOS][i] = rand()%SPACE_SIZE;
+    b->field[XVEL][i] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
+    b->field[YVEL][i] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
+    b->field[ZVEL][i] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
   }
-  else {
-    if(rank == 1) {
-      low = 0;
-      high = work << 1;
-      dataSize = dataSize << 1;
-    }
-    else {
-      low = work * rank;
-      high = low + work;
-    }
-    for(i=low;i<high;i++) {
-      bodyData[i][MASS] = rand()%MAX_MASS + 100;
-      bodyData[i][XPOS] = rand()%SPACE_SIZE;
-      bodyData[i][YPOS] = rand()%SPACE_SIZE;
-      bodyData[i][ZPOS] = rand()%SPACE_SIZE;
-      bodyData[i][XVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-      bodyData[i][YVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-      bodyData[i][ZVEL] = (rand()%BODY_VEL_START + 1) - (BODY_VEL_START / 2);
-    }
-    MPI_Send(&low, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-    MPI_Send(&bodyData[low], dataSize, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
+  for(i=0;i<worldSize;i++) {
+    displs[i] = (long)b->count * i / worldSize;
+    counts[i] = (long)b->count * (i + 1) / worldSize - displs[i];
   }
+  for(c=0;c<BODY_DATA_COLS;c++) //Straight into the master's store, its own share is already there
+    MPI_Gatherv(rank == 0 ? MPI_IN_PLACE : b->field[c] + low, high - low, MPI_DOUBLE, b->field[c], counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  free(counts);
+  free(displs);
 }
 
-void run_simulation(double body_data[][BODY_DATA_COLS], int rank, int worldSize) {
-  int i, step, newBody;
-
-  for(step=0;step<ITERATIONS;step++) {
-    MPI_Bcast(body_data, NUM_BODY * BODY_DATA_COLS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-    if(rank==0) {
-      MPI_Status stat;
-      int highestBody = 0, exitCondition = NUM_BODY + worldSize - 1;
-      newBody = -1;
+void write_trajectory(bodystore *b, trajwriter *traj, int step) { //Every rank compresses its slice of the master's state
+  const double *field[TRAJ_FIELDS] = {b->field[XPOS], b->field[YPOS], b->field[ZPOS], b->field[XVEL], b->field[YVEL], b->field[ZVEL]};
+  MPI_Bcast(b->block, b->count * BODY_DATA_COLS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  traj_write(traj, field, 1, step, MPI_COMM_WORLD);
+}
 
-      while(highestBody < exitCondition) {
-        MPI_Recv(&newBody, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &stat); //Check if that node has already computed a body
-        if(newBody >= 0) {
-          MPI_Recv(&body_data[newBody], BODY_DATA_COLS, MPI_DOUBLE, stat.MPI_SOURCE, 0, MPI_COMM_WORLD, &stat); //Receive the new body data
-        }
-        MPI_Send(&highestBody, 1, MPI_INT, stat.MPI_SOURCE, 0, MPI_COMM_WORLD); //Send the node the new body to compute
-        highestBody++;
-      }
+void run_simulation(bodystore *b, int steps, int rank, int worldSize, const integrator *scheme, frame *view, int frameEvery, const char *framePrefix, trajwriter *traj, int trajEvery) {
+  //Renders every frameEvery steps when view is set, writes every trajEvery steps to traj when set, dumps text unless
+  //either is set or the bodies are in a file. Steps are numbered on from where a file left off
+  double (*acc)[3] = malloc((size_t)b->count * sizeof(*acc));
+  int step, rendering, firstStep = b->header ? b->header->step : 0;
+
+  if(steps > 0) //Every step after reuses the last sweep of the one before
+    force_sweep(b, acc, 0, rank, worldSize, NULL);
+  for(step=0;step<steps;step++) {
+    rendering = view && (step + 1) % frameEvery == 0;
+    if(traj && step % trajEvery == 0) //The state going into this step
+      write_trajectory(b, traj, firstStep + step);
+
+    integrate_step(scheme, b, acc, TIMESTEP, 0, rank, worldSize, rendering ? view : NULL);
+    if(rank == 0 && !view && !traj && !b->header) {
       printf("Iteration %d\n\n", step+1);
-      print_data(body_data);
-    } //End master node operations
-
-    else {
-      double fx, fy, fz, r;
-      double data_copy[BODY_DATA_COLS] = {0};
-      newBody = -1;
-
-      while(1) {
-        MPI_Send(&newBody, 1, MPI_INT, 0, 0, MPI_COMM_WORLD); //Send the master node the number of the body that has been computed (will be -1 on first attempt)
-        if(newBody >= 0)
-          MPI_Send(&data_copy, BODY_DATA_COLS, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD); //Send the actual data
-        MPI_Recv(&newBody, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE); //Receive the new body to compute
-        if(newBody >= NUM_BODY)
-          break;
-        data_copy[MASS] = body_data[newBody][MASS];
-        data_copy[XPOS] = body_data[newBody][XPOS];
-        data_copy[YPOS] = body_data[newBody][YPOS];
-        data_copy[ZPOS] = body_data[newBody][ZPOS];
-        data_copy[XVEL] = body_data[newBody][XVEL];
-        data_copy[YVEL] = body_data[newBody][YVEL];
-        data_copy[ZVEL] = body_data[newBody][ZVEL];
+      print_data(b);
+    }
 
-        for(i=0;i<NUM_BODY;i++) {
-          if(i==newBody)
-            continue;
-          r = sqrt((pow(body_data[i][XPOS] - data_copy[XPOS], 2) + pow(body_data[i][YPOS] - data_copy[YPOS], 2) + pow(body_data[i][ZPOS] - data_copy[ZPOS], 2)));
-          fx = ((GRAV_CONST * body_data[i][MASS] * data_copy[MASS]) / (pow(r, 2))) * ((data_copy[XPOS] - body_data[i][XPOS]) / r);
-          fy = ((GRAV_CONST * body_data[i][MASS] * data_copy[MASS]) / (pow(r, 2))) * ((data_copy[YPOS] - body_data[i][YPOS]) / r);
-          fz = ((GRAV_CONST * body_data[i][MASS] * data_copy[MASS]) / (pow(r, 2))) * ((data_copy[ZPOS] - body_data[i][ZPOS]) / r);
-          data_copy[XVEL] += (fx * TIMESTEP / data_copy[MASS]);
-          data_copy[YVEL] += (fy * TIMESTEP / data_copy[MASS]);
-          data_copy[ZVEL] += (fz * TIMESTEP / data_copy[MASS]);
-        } //End force routine for
-        data_copy[XPOS] += data_copy[XVEL] * TIMESTEP;
-        data_copy[YPOS] += data_copy[YVEL] * TIMESTEP;
-        data_copy[ZPOS] += data_copy[ZVEL] * TIMESTEP;
-      }
-    } //End slave node operations
+    if(rendering && !frame_write(view, framePrefix, rank, MPI_COMM_WORLD))
+      fprintf(stderr, "Could not write frame %d\n", view->count - 1);
   } //End ITERATION for
+  if(traj && steps % trajEvery == 0) //The final state
+    write_trajectory(b, traj, firstStep + steps);
+  free(acc);
 }
 
 int main(int argc, char* argv[]) {
-  int rank, size;
-  double time;
-  double body_data[NUM_BODY][BODY_DATA_COLS];
+  int i, rank, size, frameEvery = 0, width = FRAME_DEFAULT_SIZE, height = FRAME_DEFAULT_SIZE, trajEvery = 1, keyInterval = TRAJ_DEFAULT_KEY_INTERVAL;
+  int count = NUM_BODY, steps = ITERATIONS, resume = 0, opened, checkEnergy;
+  double time = 0, span = 2 * SPACE_SIZE, errorBound = 1e-3, energy = 0;
+  const char *framePrefix = "nbody", *trajPath = NULL, *storePath = NULL;
+  const integrator *scheme = find_integrator("euler");
+  bodystore bodies;
+  frame view;
+  trajwriter traj;
 
   MPI_Init(&argc, &argv);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  if(rank == 0) time = MPI_Wtime();
-  init_bodies(body_data, rank, size);
-  run_simulation(body_data, rank, size);
+  for(i=1;i<argc;i++) {
+    if(strcmp(argv[i], "-bodies") == 0 && i + 1 < argc)
+      count = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-steps") == 0 && i + 1 < argc)
+      steps = atoi(argv[++i]);
+    else if((strcmp(argv[i], "-store") == 0 || strcmp(argv[i], "-resume") == 0) && i + 1 < argc) {
+      resume = strcmp(argv[i], "-resume") == 0;
+      storePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+      frameEvery = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+      width = atoi(argv[++i]);
+      height = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-span") == 0 && i + 1 < argc)
+      span = atof(argv[++i]);
+    else if(strcmp(argv[i], "-prefix") == 0 && i + 1 < argc)
+      framePrefix = argv[++i];
+    else if(strcmp(argv[i], "-integrator") == 0 && i + 1 < argc && find_integrator(argv[i+1]))
+      scheme = find_integrator(argv[++i]);
+    else if(strcmp(argv[i], "-traj") == 0 && i + 1 < argc)
+      trajPath = argv[++i];
+    else if(strcmp(argv[i], "-error") == 0 && i + 1 < argc)
+      errorBound = atof(argv[++i]);
+    else if(strcmp(argv[i], "-every") == 0 && i + 1 < argc)
+      trajEvery = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-keyframe") == 0 && i + 1 < argc)
+      keyInterval = atoi(argv[++i]);
+    else
+      break;
+  }
+  if(i < argc || count < 1 || count > INT32_MAX / BODY_DATA_COLS || steps < 0 || frameEvery < 0 || width < 1 || height < 1 || span <= 0 || errorBound <= 0 || trajEvery < 1 || keyInterval < 1) {
+    if(rank == 0)
+      fprintf(stderr, "Usage: %s [-bodies n] [-steps n] [-store file | -resume file] [-integrator euler|leapfrog|yoshida4]\n"
+        "          [-frames everySteps [-size width height] [-span units] [-prefix name]]\n"
+        "          [-traj file [-error bound] [-every steps] [-keyframe frames]]\n"
+        "  With -store, the bodies live in a new file that the run integrates in place, -resume carries on with\n"
+        "  an existing one, and nbodystat can watch either while it runs\n"
+        "  With -frames, prefix_NNNNN.ppm images of the x-y plane replace the text dump of every body\n"
+        "  With -traj, every body's position and velocity is written compressed to within bound (default 1e-3),\n"
+        "  every given number of steps, with a key frame every given number of frames; read it with traj2txt\n"
+        "  euler is the default, leapfrog costs the same one force sweep a step and is second order, yoshida4 three\n", argv[0]);
+    MPI_Finalize();
+    return 1;
+  }
+  if(frameEvery) //Centred on the starting cube, bodies drifting out of span are not drawn
+    frame_init(&view, width, height, SPACE_SIZE / 2.0, SPACE_SIZE / 2.0, span, MAX_MASS + 100, rank);
+
+  if(rank == 0) {
+    time = MPI_Wtime();
+    if(storePath && resume && (opened = store_open(&bodies, storePath, 1)) != 1) {
+      fprintf(stderr, opened < 0 ? "%s was left part way through a step by a run that stopped, its bodies are not all from one time\n" : "%s is not a body store\n", storePath);
+      count = 0;
+    }
+    else if(storePath && !resume && !store_create(&bodies, storePath, count)) {
+      fprintf(stderr, "Could not create %s\n", storePath);
+      count = 0;
+    }
+    else if(!storePath && !store_alloc(&bodies, count)) {
+      fprintf(stderr, "No memory for %d bodies\n", count);
+      count = 0;
+    }
+    else
+      count = bodies.count; //A resumed file's
+  }
+  MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if(count == 0 || (rank != 0 && !store_alloc(&bodies, count))) { //The nodes only ever hold copies
+    if(frameEvery)
+      frame_free(&view);
+    MPI_Finalize();
+    return 1;
+  }
+
+  if(resume) {
+    if(rank == 0)
+      printf("Resuming %d bodies at step %lld from %s\n", count, (long long)bodies.header->step, storePath);
+  }
+  else {
+    init_bodies(&bodies, rank, size);
+    store_end(&bodies, 0, 0, 0); //A new file is whole from here
+  }
+  if(rank == 0 && !frameEvery && !trajPath && !storePath) {
+    printf("Intial state\n");
+    print_data(&bodies);
+  }
+  if(trajPath) {
+    MPI_Bcast(bodies.block, count * BODY_DATA_COLS, MPI_DOUBLE, 0, MPI_COMM_WORLD); //Only rank 0 has every mass yet
+    if(!traj_open(&traj, trajPath, count, bodies.field[MASS], 1, errorBound, TIMESTEP, trajEvery, keyInterval, MPI_COMM_WORLD)) {
+      if(rank == 0)
+        fprintf(stderr, "Could not create %s\n", trajPath);
+      trajPath = NULL;
+    }
+  }
+  checkEnergy = rank == 0 && count <= ENERGY_CHECK_BODIES;
+  if(checkEnergy)
+    energy = total_energy(&bodies, 0);
+  run_simulation(&bodies, steps, rank, size, scheme, frameEvery ? &view : NULL, frameEvery, framePrefix, trajPath ? &traj : NULL, trajEvery);
   if(rank == 0) {
     time = MPI_Wtime() - time;
     printf("\nSimulation finished\nExecuted in %f seconds\n", time);
+    if(checkEnergy)
+      printf("%s integrator, relative energy error %g\n", scheme->name, fabs((total_energy(&bodies, 0) - energy) / energy));
+    if(storePath)
+      printf("%s holds %d bodies at step %lld\n", storePath, count, (long long)bodies.header->step);
+    if(frameEvery)
+      printf("%d frames of %dx%d written to %s_*.ppm\n", view.count, width, height, framePrefix);
   }
+  if(frameEvery)
+    frame_free(&view);
+  if(trajPath)
+    traj_close(&traj, MPI_COMM_WORLD);
+  store_close(&bodies);
   MPI_Finalize();
   return 0;
 }
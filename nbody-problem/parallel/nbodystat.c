@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "bodystore.h"
+
+//Summarises a body store written by nbody -store or -resume, safely while the run is still going. The file is
+//mapped read-only and each report works on a consistent copy taken while the master is not writing, nothing
+//is parsed. A live run is mostly in a force sweep, so the copy is usually part way through a step, which
+//the report says, with the positions and velocities of its stages so far.
+//Build without MPI: cc -O2 -o nbodystat nbodystat.c -lm
+//Usage: nbodystat file [-energy] [-print first count] [-watch seconds] [-wait seconds]
+//-energy adds the O(N^2) potential, -print lists bodies in nbody's text layout, -watch reports again every
+//time the run has moved on, until interrupted. -wait is how long to wait for the master to stop writing, 60 by default.
+
+#define DEFAULT_WAIT 60
+
+void report(const bodystore *b, const storeheader *header, int energy) {
+  double mass = 0, centre[3] = {0}, momentum[3] = {0}, low[3], high[3], kinetic = 0, potential = 0, r;
+  int i, j, c;
+  for(c=0;c<3;c++)
+    low[c] = high[c] = b->field[XPOS + c][0];
+  for(i=0;i<b->count;i++) {
+    mass += b->field[MASS][i];
+    for(c=0;c<3;c++) {
+      centre[c] += b->field[MASS][i] * b->field[XPOS + c][i];
+      momentum[c] += b->field[MASS][i] * b->field[XVEL + c][i];
+      kinetic += 0.5 * b->field[MASS][i] * pow(b->field[XVEL + c][i], 2);
+      if(b->field[XPOS + c][i] < low[c]) low[c] = b->field[XPOS + c][i];
+      if(b->field[XPOS + c][i] > high[c]) high[c] = b->field[XPOS + c][i];
+    }
+  }
+  if(header->stage)
+    printf("Step %lld, time %g, and %lld sweeps into step %lld, %d bodies of total mass %g\n", (long long)header->step, header->time, (long long)header->stage, (long long)header->step + 1, b->count, mass);
+  else
+    printf("Step %lld, time %g, %d bodies of total mass %g\n", (long long)header->step, header->time, b->count, mass);
+  printf("  centre of mass  %16.4f %16.4f %16.4f\n", centre[0] / mass, centre[1] / mass, centre[2] / mass);
+  printf("  momentum        %16.4f %16.4f %16.4f\n", momentum[0], momentum[1], momentum[2]);
+  printf("  box from        %16.4f %16.4f %16.4f\n", low[0], low[1], low[2]);
+  printf("          to      %16.4f %16.4f %16.4f\n", high[0], high[1], high[2]);
+  printf("  kinetic energy  %g, rms speed %g\n", kinetic, sqrt(2 * kinetic / mass));
+  if(energy) { //Unsoftened, as nbody runs
+    for(i=0;i<b->count;i++)
+      for(j=i+1;j<b->count;j++) {
+        r = sqrt(pow(b->field[XPOS][i] - b->field[XPOS][j], 2) + pow(b->field[YPOS][i] - b->field[YPOS][j], 2) + pow(b->field[ZPOS][i] - b->field[ZPOS][j], 2));
+        potential -= b->field[MASS][i] * b->field[MASS][j] / r;
+      }
+    printf("  potential energy %g, total %g\n", potential, kinetic + potential);
+  }
+}
+
+void print_bodies(const bodystore *b, int first, int count) {
+  int i, j;
+  for(i=first;i<first+count && i<b->count;i++) {
+    printf("[%d]\t", i+1);
+    for(j=0;j<BODY_DATA_COLS;j++) {
+      if(j == 0) printf("%-6.0f", b->field[j][i]);
+      else printf("%-16.4f", b->field[j][i]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  int i, energy = 0, first = 0, count = 0;
+  double watch = 0, wait = DEFAULT_WAIT;
+  long long lastStep = -1, lastStage = -1;
+  bodystore live, copy;
+  storeheader header;
+
+  for(i=2;i<argc;i++) {
+    if(strcmp(argv[i], "-energy") == 0)
+      energy = 1;
+    else if(strcmp(argv[i], "-print") == 0 && i + 2 < argc) {
+      first = atoi(argv[++i]) - 1; //Numbered from 1 like the text dump
+      count = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-watch") == 0 && i + 1 < argc)
+      watch = atof(argv[++i]);
+    else if(strcmp(argv[i], "-wait") == 0 && i + 1 < argc)
+      wait = atof(argv[++i]);
+    else
+      break;
+  }
+  if(argc < 2 || i < argc || first < 0 || count < 0 || watch < 0 || wait < 0) {
+    fprintf(stderr, "Usage: %s file [-energy] [-print first count] [-watch seconds] [-wait seconds]\n", argv[0]);
+    return 1;
+  }
+  if(!store_open(&live, argv[1], 0)) {
+    fprintf(stderr, "%s is not a body store\n", argv[1]);
+    return 1;
+  }
+  if(!store_alloc(&copy, live.count)) {
+    fprintf(stderr, "No memory for a copy of %d bodies\n", live.count);
+    store_close(&live);
+    return 1;
+  }
+
+  do {
+    if(!store_snapshot(&live, &copy, &header, watch ? watch : wait)) {
+      if(watch) //Still in the same step, look again later
+        continue;
+      fprintf(stderr, "%s has been written to for %g seconds, its run may have died\n", argv[1], wait);
+      break;
+    }
+    if(header.step != lastStep || header.stage != lastStage) {
+      lastStep = header.step;
+      lastStage = header.stage;
+      report(&copy, &header, energy);
+      if(count)
+        print_bodies(&copy, first, count);
+      fflush(stdout);
+    }
+    if(watch) {
+      struct timespec pause = {(time_t)watch, (long)((watch - (time_t)watch) * 1e9)};
+      nanosleep(&pause, NULL);
+    }
+  } while(watch);
+  store_close(&copy);
+  store_close(&live);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trajectory.h"
+
+//Prints frames of a trajectory written by nbody -traj, in the same layout as nbody's text dump.
+//Build without MPI: cc -O2 -o traj2txt traj2txt.c -lm
+
+void print_frame(const trajreader *r) {
+  int i, f;
+  printf("Step %d\n\n", r->step);
+  for(i=0;i<r->header.bodies;i++) {
+    printf("[%d]\t%-6.0f", i+1, r->mass[i]);
+    for(f=0;f<TRAJ_FIELDS;f++)
+      printf("%-16.4f", traj_value(r, i, f));
+    printf("\n");
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  trajreader r;
+  int frame, first = 0, last = -1, info = argc == 3 && strcmp(argv[2], "-info") == 0;
+
+  if(argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s file [frame | -info]\n  Prints one frame, every frame without one, or the file's layout with -info\n", argv[0]);
+    return 1;
+  }
+  if(!traj_read_open(&r, argv[1])) {
+    fprintf(stderr, "%s is not a complete trajectory file\n", argv[1]);
+    traj_read_close(&r);
+    return 1;
+  }
+  if(info) {
+    printf("%d bodies in %d slices, %lld frames %d steps of %g apart, key frame every %d, error bound %g\n",
+      r.header.bodies, r.header.slices, (long long)r.frames, r.header.stepsPerFrame, r.header.timestep, r.header.keyInterval, r.header.errorBound);
+    for(frame=0;frame<r.frames;frame++)
+      printf("Frame %d at byte %lld%s\n", frame, (long long)r.index[frame], frame % r.header.keyInterval == 0 ? ", key" : "");
+    traj_read_close(&r);
+    return 0;
+  }
+  last = r.frames - 1;
+  if(argc == 3) {
+    first = last = atoi(argv[2]);
+    if(first < 0 || first >= r.frames) {
+      fprintf(stderr, "Frame %d is not in 0 to %lld\n", first, (long long)r.frames - 1);
+      traj_read_close(&r);
+      return 1;
+    }
+  }
+  for(frame=first;frame<=last;frame++) {
+    if(!traj_read_frame(&r, frame)) {
+      fprintf(stderr, "Frame %d is damaged\n", frame);
+      traj_read_close(&r);
+      return 1;
+    }
+    print_frame(&r);
+  }
+  traj_read_close(&r);
+  return 0;
+}
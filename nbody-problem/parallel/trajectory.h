@@ -0,0 +1,384 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+//Compressed trajectory file, every body's position and velocity per written step within an absolute error bound.
+//The header holds the static fields once (the masses, exactly), then come the frames, then an index of frame
+//offsets and a trailer pointing at it. A frame is split into slices of consecutive bodies, one per writing rank,
+//each compressed on its own. A value is predicted from the previous frame as the reader will rebuild it, a
+//position moved on by its velocity over the steps between frames and a velocity unchanged. The difference is
+//quantised to a multiple of twice the error bound and stored as a Rice code, with the Rice parameter picked per
+//field per slice from the mean size of the differences. Every keyInterval-th frame is a key frame predicted
+//from zero instead, so any frame is rebuilt by decoding forward from the key frame before it.
+//The writer (only compiled when mpi.h is included) has every rank encode its slice and write it with MPI-IO.
+
+#define TRAJ_MAGIC "NBTRAJ1\n"
+#define TRAJ_INDEX_MAGIC "NBTRIDX\n"
+#define TRAJ_FIELDS 6 //x, y, z, vx, vy, vz
+#define TRAJ_ESCAPE 24 //Quotients this long are stored as a raw 64 bit value instead
+#define TRAJ_DEFAULT_KEY_INTERVAL 32
+
+typedef struct { //On-disk header, followed by the bodies' masses
+  char magic[8];
+  int32_t bodies, slices, keyInterval, stepsPerFrame;
+  double errorBound, timestep;
+} trajheader;
+
+typedef struct { //Before every frame's slices
+  int32_t step, key;
+  int64_t bytes; //Slices, their headers included
+} trajframe;
+
+typedef struct { //Before every slice's Rice codes
+  int32_t first, count, bytes, pad; //bytes of codes after this header
+} trajchunk;
+
+typedef struct { //At the very end of the file
+  int64_t indexOffset, frames;
+  char magic[8];
+} trajtrailer;
+
+typedef struct { //Bodies first to first + count, as the reader rebuilds them
+  int first, count;
+  double *recon; //count rows of TRAJ_FIELDS
+} trajslice;
+
+typedef struct {
+  unsigned char *buf;
+  size_t size, capacity;
+  uint64_t acc; //Bits not yet in buf, lowest first
+  int bits;
+} trajbits;
+
+static inline void tb_reserve(trajbits *b, size_t bytes) {
+  if(b->size + bytes > b->capacity) {
+    b->capacity = (b->size + bytes) * 2;
+    b->buf = realloc(b->buf, b->capacity);
+  }
+}
+
+static inline void tb_put(trajbits *b, uint64_t value, int n) { //Appends the low n bits of value, n at most 32
+  b->acc |= (value & (((uint64_t)1 << n) - 1)) << b->bits;
+  b->bits += n;
+  tb_reserve(b, 8);
+  while(b->bits >= 8) {
+    b->buf[b->size++] = b->acc & 0xff;
+    b->acc >>= 8;
+    b->bits -= 8;
+  }
+}
+
+static inline void tb_flush(trajbits *b) { //Pads the last byte with zeros
+  if(b->bits)
+    tb_put(b, 0, 8 - b->bits);
+}
+
+static inline uint64_t tb_get(const unsigned char *buf, size_t *bit, int n) { //Reads n bits at *bit and moves past them
+  uint64_t value = 0;
+  int i;
+  for(i=0;i<n;i++, (*bit)++)
+    value |= (uint64_t)((buf[*bit >> 3] >> (*bit & 7)) & 1) << i;
+  return value;
+}
+
+static inline uint64_t traj_zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t traj_unzigzag(uint64_t u) {
+  return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+static inline void traj_slice_init(trajslice *s, int first, int count) {
+  s->first = first;
+  s->count = count;
+  s->recon = calloc((size_t)(count ? count : 1) * TRAJ_FIELDS, sizeof(double));
+}
+
+static inline void traj_slice_free(trajslice *s) {
+  free(s->recon);
+}
+
+static inline double traj_predict(const double *row, int field, double dt, int key) { //Position moved on by its velocity, velocity unchanged
+  if(key)
+    return 0;
+  return field < 3 ? row[field] + row[field + 3] * dt : row[field];
+}
+
+static inline void traj_rebuild(trajslice *s, const int64_t *q, double quantum, double dt, int key) { //q holds every field of one body after another
+  double next[TRAJ_FIELDS], *row;
+  int i, f;
+  for(i=0;i<s->count;i++) {
+    row = s->recon + (size_t)i * TRAJ_FIELDS;
+    for(f=0;f<TRAJ_FIELDS;f++) //Predicted from the old row before any of it changes
+      next[f] = traj_predict(row, f, dt, key) + q[(size_t)i * TRAJ_FIELDS + f] * quantum;
+    memcpy(row, next, sizeof(next));
+  }
+}
+
+static inline void traj_put_codes(trajbits *out, const int64_t *q, int count, int field) { //One field of every body, Rice coded
+  double mean = 0;
+  int i, k;
+  for(i=0;i<count;i++)
+    mean += traj_zigzag(q[(size_t)i * TRAJ_FIELDS + field]);
+  mean /= count ? count : 1;
+  for(k=0;k<62 && ldexp(1, k + 1) <= mean;k++); //Close to the best parameter for a geometric spread
+  tb_put(out, k, 6);
+  for(i=0;i<count;i++) {
+    uint64_t u = traj_zigzag(q[(size_t)i * TRAJ_FIELDS + field]), quotient = u >> k;
+    if(quotient >= TRAJ_ESCAPE) { //All ones and no zero, then the value in full
+      tb_put(out, ((uint64_t)1 << TRAJ_ESCAPE) - 1, TRAJ_ESCAPE);
+      tb_put(out, u, 32);
+      tb_put(out, u >> 32, 32);
+      continue;
+    }
+    tb_put(out, ((uint64_t)1 << quotient) - 1, quotient + 1); //quotient ones and a zero
+    tb_put(out, u, k < 32 ? k : 32);
+    if(k > 32)
+      tb_put(out, u >> 32, k - 32);
+  }
+}
+
+static inline void traj_get_codes(const unsigned char *buf, size_t *bit, int64_t *q, int count, int field) {
+  int i, k = tb_get(buf, bit, 6);
+  for(i=0;i<count;i++) {
+    uint64_t quotient = 0, u;
+    while(quotient < TRAJ_ESCAPE && tb_get(buf, bit, 1))
+      quotient++;
+    if(quotient == TRAJ_ESCAPE) {
+      u = tb_get(buf, bit, 32);
+      u |= tb_get(buf, bit, 32) << 32;
+    }
+    else
+      u = quotient << k | tb_get(buf, bit, k);
+    q[(size_t)i * TRAJ_FIELDS + field] = traj_unzigzag(u);
+  }
+}
+
+static inline void traj_encode(trajslice *s, const double *const field[TRAJ_FIELDS], int stride, double quantum, double dt, int key, trajbits *out, double *maxError) {
+  //field[f][i * stride] is field f of body s->first + i, appends the codes to out
+  int64_t *q = malloc((size_t)(s->count ? s->count : 1) * TRAJ_FIELDS * sizeof(int64_t));
+  double error;
+  int f, i;
+  for(i=0;i<s->count;i++)
+    for(f=0;f<TRAJ_FIELDS;f++)
+      q[(size_t)i * TRAJ_FIELDS + f] = llround((field[f][(size_t)i * stride] - traj_predict(s->recon + (size_t)i * TRAJ_FIELDS, f, dt, key)) / quantum);
+  for(f=0;f<TRAJ_FIELDS;f++)
+    traj_put_codes(out, q, s->count, f);
+  tb_flush(out);
+  traj_rebuild(s, q, quantum, dt, key); //The next frame is predicted from what the reader will see
+  for(i=0;i<s->count;i++)
+    for(f=0;f<TRAJ_FIELDS;f++) {
+      error = fabs(s->recon[(size_t)i * TRAJ_FIELDS + f] - field[f][(size_t)i * stride]);
+      if(error > *maxError)
+        *maxError = error;
+    }
+  free(q);
+}
+
+static inline void traj_decode(trajslice *s, const unsigned char *codes, double quantum, double dt, int key) {
+  int64_t *q = malloc((size_t)(s->count ? s->count : 1) * TRAJ_FIELDS * sizeof(int64_t));
+  size_t bit = 0;
+  int f;
+  for(f=0;f<TRAJ_FIELDS;f++)
+    traj_get_codes(codes, &bit, q, s->count, f);
+  traj_rebuild(s, q, quantum, dt, key);
+  free(q);
+}
+
+
+typedef struct {
+  FILE *file;
+  trajheader header;
+  double *mass;
+  int64_t *index, frames;
+  trajslice *slices;
+  int current; //Frame held in slices, -1 for none
+  int step; //Simulation step of that frame
+} trajreader;
+
+static inline int traj_read_open(trajreader *r, const char *path) { //Returns 0 if the file is missing or not a whole trajectory
+  trajtrailer trailer;
+  int s;
+  memset(r, 0, sizeof(trajreader));
+  r->current = -1;
+  if((r->file = fopen(path, "rb")) == NULL)
+    return 0;
+  if(fread(&r->header, sizeof(trajheader), 1, r->file) != 1 || memcmp(r->header.magic, TRAJ_MAGIC, 8) != 0 || r->header.slices < 1)
+    return 0;
+  r->mass = malloc((size_t)r->header.bodies * sizeof(double));
+  if(fread(r->mass, sizeof(double), r->header.bodies, r->file) != (size_t)r->header.bodies)
+    return 0;
+  if(fseek(r->file, -(long)sizeof(trajtrailer), SEEK_END) != 0 || fread(&trailer, sizeof(trajtrailer), 1, r->file) != 1 || memcmp(trailer.magic, TRAJ_INDEX_MAGIC, 8) != 0)
+    return 0; //No trailer, the writer did not finish
+  r->frames = trailer.frames;
+  r->index = malloc((size_t)(r->frames ? r->frames : 1) * sizeof(int64_t));
+  if(fseek(r->file, trailer.indexOffset, SEEK_SET) != 0 || fread(r->index, sizeof(int64_t), r->frames, r->file) != (size_t)r->frames)
+    return 0;
+  r->slices = malloc(r->header.slices * sizeof(trajslice));
+  for(s=0;s<r->header.slices;s++) //Every slice's bounds, the same as the writer's
+    traj_slice_init(&r->slices[s], (int)((long)r->header.bodies * s / r->header.slices), (int)((long)r->header.bodies * (s + 1) / r->header.slices - (long)r->header.bodies * s / r->header.slices));
+  return 1;
+}
+
+static inline int traj_read_frame(trajreader *r, int frame) { //Rebuilds a frame into r->slices, returns 0 if it cannot
+  double quantum = 2 * r->header.errorBound, dt = r->header.timestep * r->header.stepsPerFrame;
+  int f, s, start = frame - frame % r->header.keyInterval;
+  unsigned char *codes = NULL;
+  if(frame < 0 || frame >= r->frames)
+    return 0;
+  if(r->current >= start && r->current <= frame) //Carry on from what is already decoded
+    start = r->current + 1;
+  for(f=start;f<=frame;f++) {
+    trajframe header;
+    if(fseek(r->file, r->index[f], SEEK_SET) != 0 || fread(&header, sizeof(trajframe), 1, r->file) != 1)
+      break;
+    for(s=0;s<r->header.slices;s++) {
+      trajchunk chunk;
+      if(fread(&chunk, sizeof(trajchunk), 1, r->file) != 1 || chunk.count != r->slices[s].count)
+        break;
+      codes = realloc(codes, chunk.bytes + 1);
+      if(fread(codes, 1, chunk.bytes, r->file) != (size_t)chunk.bytes)
+        break;
+      traj_decode(&r->slices[s], codes, quantum, dt, header.key);
+    }
+    if(s < r->header.slices)
+      break;
+    r->current = f;
+    r->step = header.step;
+  }
+  if(f <= frame) //Stopped part way, the slices may hold pieces of two frames
+    r->current = -1;
+  free(codes);
+  return r->current == frame;
+}
+
+static inline double traj_value(const trajreader *r, int body, int field) { //Field of a body in the frame last read
+  int s;
+  for(s=0;s<r->header.slices-1 && body>=r->slices[s+1].first;s++);
+  return r->slices[s].recon[(size_t)(body - r->slices[s].first) * TRAJ_FIELDS + field];
+}
+
+static inline void traj_read_close(trajreader *r) {
+  int s;
+  if(r->slices)
+    for(s=0;s<r->header.slices;s++)
+      traj_slice_free(&r->slices[s]);
+  free(r->slices);
+  free(r->mass);
+  free(r->index);
+  if(r->file)
+    fclose(r->file);
+}
+
+#ifdef MPI_VERSION
+
+typedef struct {
+  MPI_File file;
+  MPI_Offset offset; //End of the frames written so far, the same on every rank
+  trajheader header;
+  trajslice slice; //This rank's bodies
+  trajbits bits;
+  int rank, size;
+  int64_t frames, *index, indexCapacity; //Frame offsets, rank 0 only
+  double seconds, maxError; //This rank's time encoding and writing, and the worst error it has seen
+} trajwriter;
+
+static inline int traj_open(trajwriter *w, const char *path, int bodies, const double *mass, int massStride, double errorBound, double timestep, int stepsPerFrame, int keyInterval, MPI_Comm comm) {
+  //Every rank of comm calls it and writes a slice of each frame, returns 0 on every rank if the file cannot be created
+  int i, ok;
+  memset(w, 0, sizeof(trajwriter));
+  MPI_Comm_rank(comm, &w->rank);
+  MPI_Comm_size(comm, &w->size);
+  memcpy(w->header.magic, TRAJ_MAGIC, 8);
+  w->header.bodies = bodies;
+  w->header.slices = w->size;
+  w->header.keyInterval = keyInterval;
+  w->header.stepsPerFrame = stepsPerFrame;
+  w->header.errorBound = errorBound;
+  w->header.timestep = timestep;
+  MPI_File_delete(path, MPI_INFO_NULL); //An old file longer than this one would keep its tail
+  ok = MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &w->file) == MPI_SUCCESS;
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+  if(!ok)
+    return 0;
+  if(w->rank == 0) { //Header and the masses, once
+    double *masses = malloc((size_t)bodies * sizeof(double));
+    for(i=0;i<bodies;i++)
+      masses[i] = mass[(size_t)i * massStride];
+    MPI_File_write_at(w->file, 0, &w->header, sizeof(trajheader), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at(w->file, sizeof(trajheader), masses, bodies, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    free(masses);
+  }
+  w->offset = sizeof(trajheader) + (MPI_Offset)bodies * sizeof(double);
+  traj_slice_init(&w->slice, (int)((long)bodies * w->rank / w->size), (int)((long)bodies * (w->rank + 1) / w->size - (long)bodies * w->rank / w->size));
+  return 1;
+}
+
+static inline void traj_write(trajwriter *w, const double *const field[TRAJ_FIELDS], int stride, int step, MPI_Comm comm) {
+  //field[f][i * stride] is field f of body i for every body, each rank only reads its own slice
+  const double *mine[TRAJ_FIELDS];
+  double start = MPI_Wtime();
+  int64_t bytes, before, total;
+  size_t lead = (w->rank == 0 ? sizeof(trajframe) : 0) + sizeof(trajchunk); //Rank 0's slice comes first, after the frame header
+  trajframe frame = {step, w->frames % w->header.keyInterval == 0, 0};
+  trajchunk chunk = {w->slice.first, w->slice.count, 0, 0};
+  int f;
+
+  for(f=0;f<TRAJ_FIELDS;f++)
+    mine[f] = field[f] + (size_t)w->slice.first * stride;
+  w->bits.size = 0;
+  tb_reserve(&w->bits, lead);
+  w->bits.size = lead;
+  traj_encode(&w->slice, mine, stride, 2 * w->header.errorBound, w->header.timestep * w->header.stepsPerFrame, frame.key, &w->bits, &w->maxError);
+  chunk.bytes = w->bits.size - lead;
+  memcpy(w->bits.buf + lead - sizeof(trajchunk), &chunk, sizeof(trajchunk));
+  bytes = w->bits.size;
+  MPI_Exscan(&bytes, &before, 1, MPI_INT64_T, MPI_SUM, comm);
+  if(w->rank == 0)
+    before = 0;
+  total = before + bytes;
+  MPI_Bcast(&total, 1, MPI_INT64_T, w->size - 1, comm); //The last rank's end is the frame's end
+  if(w->rank == 0) {
+    frame.bytes = total - sizeof(trajframe);
+    memcpy(w->bits.buf, &frame, sizeof(trajframe));
+    if(w->frames == w->indexCapacity) {
+      w->indexCapacity = w->indexCapacity ? w->indexCapacity * 2 : 256;
+      w->index = realloc(w->index, w->indexCapacity * sizeof(int64_t));
+    }
+    w->index[w->frames] = w->offset;
+  }
+  MPI_File_write_at_all(w->file, w->offset + before, w->bits.buf, bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+  w->offset += total;
+  w->frames++;
+  w->seconds += MPI_Wtime() - start;
+}
+
+static inline void traj_close(trajwriter *w, MPI_Comm comm) { //Writes the index and trailer, rank 0 reports the compression
+  double seconds, maxError;
+  MPI_Reduce(&w->seconds, &seconds, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(&w->maxError, &maxError, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+  if(w->rank == 0) {
+    trajtrailer trailer = {w->offset, w->frames, TRAJ_INDEX_MAGIC};
+    double raw = (double)w->frames * w->header.bodies * 7 * sizeof(double); //Every body's 7 doubles every frame
+    long long fileBytes = w->offset + w->frames * sizeof(int64_t) + sizeof(trajtrailer);
+    MPI_File_write_at(w->file, w->offset, w->index, w->frames, MPI_INT64_T, MPI_STATUS_IGNORE);
+    MPI_File_write_at(w->file, w->offset + w->frames * sizeof(int64_t), &trailer, sizeof(trajtrailer), MPI_BYTE, MPI_STATUS_IGNORE);
+    printf("Trajectory: %lld frames of %d bodies in %lld bytes, %.1fx smaller than raw doubles, max error %g (bound %g)\n",
+      (long long)w->frames, w->header.bodies, fileBytes, raw / fileBytes, maxError, w->header.errorBound);
+    printf("Trajectory: %f seconds encoding and writing, %.1f MB/s written, %.1f MB/s of raw doubles\n", seconds, fileBytes / seconds / 1e6, raw / seconds / 1e6);
+  }
+  MPI_File_close(&w->file);
+  traj_slice_free(&w->slice);
+  free(w->bits.buf);
+  free(w->index);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "view.h"
+#include "deepzoom.h"
+#include "linecodec.h"
+#include "render.h"
+
+//Benchmarks the ways of sharing out an image over a standard set of views at 1, 2, 4 ... ranks.
+//Each run uses the first n ranks of MPI_COMM_WORLD, rank 0 of the run is the master and only collects.
+//Every rank times its compute, communication and idle time and counts the messages and bytes it sends.
+//Results go to stdout and to prefix.csv (one row per run) and prefix.json (with the per-rank numbers).
+//Every image is checked against a single rank render of the same view cut into the same unit shape, since
+//float kernels started at a tile's left edge round differently from ones started at the row's.
+
+#define UNIT_TAG 1 //Unit numbers from the master, -1 to stop
+#define RESULT_TAG 2 //Unit number followed by the encoded counts
+#define BENCH_DEPTH 2 //Outstanding units per worker in the dynamic policies
+#define BENCH_TILE 32 //Tile edge for the tile policy
+#define BENCH_CHUNK 8 //Rows per unit for the chunk policy
+#define BENCH_SIZE 400 //Default image width and height
+
+typedef struct {
+	const char *name;
+	const char *args; //Command line for parse_view
+} benchview;
+
+static const benchview views[] = { //Cheap to expensive, then deep
+	{"outside", "-c 1.5 1.5 -z 2 -i 1000"}, //Nearly every point escapes within a few iterations
+	{"full", "-i 1000"}, //The whole set, cost piles up in the middle rows
+	{"interior", "-c -0.2 0 -z 8 -i 1000"}, //Mostly inside the main cardioid, every pixel runs to the limit
+	{"seahorse", "-c -0.743643887037151 0.13182590420533 -z 1000 -i 2000"}, //Filaments, very uneven rows
+	{"deep", "-c -0.743643887037151 0.13182590420533 -z 1e12 -i 3000"} //Perturbation from a reference orbit
+};
+
+typedef struct {
+	const char *name;
+	int dynamic; //Master hands out units on demand instead of a fixed assignment
+	int rows, tile; //Unit shape, rows per unit or square tiles when tile is set
+	int blocks; //Static only, one contiguous block of rows per worker
+} policy;
+
+static const policy policies[] = {
+	{"static-rows", 0, 1, 0, 0}, //What static_mandelbrot does with lines
+	{"static-blocks", 0, 0, 0, 1},
+	{"dynamic-rows", 1, 1, 0, 0}, //What dynamic_mandelbrot does with lines
+	{"dynamic-chunks", 1, BENCH_CHUNK, 0, 0},
+	{"dynamic-tiles", 1, 0, BENCH_TILE, 0}
+};
+
+typedef struct { //What one rank measured during a run
+	double compute, comm, idle;
+	double messages, bytes;
+} rankstats;
+
+typedef struct { //Rectangles handed out as work units
+	int count;
+	int *x0, *y0, *w, *h;
+} unitlist;
+
+static void make_units(const mandelview *view, const policy *pol, int nodes, unitlist *units) {
+	int i, x, y, rows;
+	units->count = 0;
+	if(pol->blocks)
+		units->count = nodes;
+	else if(pol->tile)
+		units->count = ((view->width + pol->tile - 1) / pol->tile) * ((view->height + pol->tile - 1) / pol->tile);
+	else
+		units->count = (view->height + pol->rows - 1) / pol->rows;
+	units->x0 = malloc(units->count * sizeof(int));
+	units->y0 = malloc(units->count * sizeof(int));
+	units->w = malloc(units->count * sizeof(int));
+	units->h = malloc(units->count * sizeof(int));
+	for(i=0;i<units->count;++i) {
+		if(pol->blocks) {
+			units->x0[i] = 0;
+			units->w[i] = view->width;
+			units->y0[i] = (long)view->height * i / nodes;
+			units->h[i] = (long)view->height * (i + 1) / nodes - units->y0[i];
+		}
+		else if(pol->tile) {
+			int across = (view->width + pol->tile - 1) / pol->tile;
+			x = (i % across) * pol->tile;
+			y = (i / across) * pol->tile;
+			units->x0[i] = x;
+			units->y0[i] = y;
+			units->w[i] = view->width - x < pol->tile ? view->width - x : pol->tile;
+			units->h[i] = view->height - y < pol->tile ? view->height - y : pol->tile;
+		}
+		else {
+			rows = pol->rows;
+			units->x0[i] = 0;
+			units->y0[i] = i * rows;
+			units->w[i] = view->width;
+			units->h[i] = view->height - i * rows < rows ? view->height - i * rows : rows;
+		}
+	}
+}
+
+static void free_units(unitlist *units) {
+	free(units->x0);
+	free(units->y0);
+	free(units->w);
+	free(units->h);
+}
+
+static void render_units(const mandelview *view, const dzorbit *orbit, const unitlist *units, int *image) { //Single rank render of every unit in turn
+	int i, y, *tile = malloc((size_t)view->width * view->height * sizeof(int));
+	for(i=0;i<units->count;++i) {
+		render_tile(view, orbit, units->x0[i], units->y0[i], units->w[i], units->h[i], tile);
+		for(y=0;y<units->h[i];++y)
+			memcpy(image + (size_t)(units->y0[i] + y) * view->width + units->x0[i], tile + y * units->w[i], units->w[i] * sizeof(int));
+	}
+	free(tile);
+}
+
+static double run_policy(MPI_Comm comm, const mandelview *view, const dzorbit *orbit, const policy *pol, int *image, rankstats *stats) { //Renders the view once, returns the master's wall time
+	int rank, size, nodes, i, unit, stop = -1, packetSize, packetBytes, maxPixels = 0;
+	unitlist units;
+	unsigned char *packet;
+	int *tile;
+	double start, t, wall = 0;
+	MPI_Status stat;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+	nodes = size - 1;
+	memset(stats, 0, sizeof(rankstats));
+	make_units(view, pol, nodes, &units);
+	for(i=0;i<units.count;++i)
+		if(units.w[i] * units.h[i] > maxPixels)
+			maxPixels = units.w[i] * units.h[i];
+	packetBytes = sizeof(int) + LC_MAX_BYTES(maxPixels);
+	packet = malloc(packetBytes);
+	tile = malloc(maxPixels * sizeof(int));
+
+	MPI_Barrier(comm);
+	start = MPI_Wtime();
+	if(rank == 0) {
+		int nextUnit = 0, *outstanding = calloc(size, sizeof(int)), *stopped = calloc(size, sizeof(int)), node, j; //A second stop would be read as the next repetition's first unit
+		if(pol->dynamic) {
+			t = MPI_Wtime();
+			for(node=1;node<size;++node) //Fill every worker's queue
+				for(j=0;j<BENCH_DEPTH;++j) {
+					int assign = nextUnit < units.count ? nextUnit++ : stop;
+					MPI_Send(&assign, 1, MPI_INT, node, UNIT_TAG, comm);
+					stats->messages += 1;
+					stats->bytes += sizeof(int);
+					outstanding[node] += assign >= 0;
+					if(assign < 0) {
+						stopped[node] = 1;
+						break;
+					}
+				}
+			stats->comm += MPI_Wtime() - t;
+		}
+		for(i=0;i<units.count;++i) {
+			t = MPI_Wtime();
+			MPI_Recv(packet, packetBytes, MPI_BYTE, MPI_ANY_SOURCE, RESULT_TAG, comm, &stat); //Waiting on workers is idle time
+			stats->idle += MPI_Wtime() - t;
+			t = MPI_Wtime();
+			MPI_Get_count(&stat, MPI_BYTE, &packetSize);
+			memcpy(&unit, packet, sizeof(int));
+			lc_decode(packet + sizeof(int), packetSize - sizeof(int), view->maxIter, tile, units.w[unit] * units.h[unit]);
+			for(j=0;j<units.h[unit];++j)
+				memcpy(image + (size_t)(units.y0[unit] + j) * view->width + units.x0[unit], tile + j * units.w[unit], units.w[unit] * sizeof(int));
+			if(pol->dynamic) { //Top the worker back up, or stop it once its queue drains
+				node = stat.MPI_SOURCE;
+				--outstanding[node];
+				if(nextUnit < units.count || (outstanding[node] == 0 && !stopped[node])) {
+					int assign = nextUnit < units.count ? nextUnit++ : stop;
+					MPI_Send(&assign, 1, MPI_INT, node, UNIT_TAG, comm);
+					stats->messages += 1;
+					stats->bytes += sizeof(int);
+					outstanding[node] += assign >= 0;
+					stopped[node] = assign < 0;
+				}
+			}
+			stats->comm += MPI_Wtime() - t;
+		}
+		free(outstanding);
+		free(stopped);
+		wall = MPI_Wtime() - start;
+	}
+	else {
+		i = rank - 1;
+		while(1) {
+			if(pol->dynamic) {
+				t = MPI_Wtime();
+				MPI_Recv(&unit, 1, MPI_INT, 0, UNIT_TAG, comm, MPI_STATUS_IGNORE); //Waiting for work is idle time
+				stats->idle += MPI_Wtime() - t;
+				if(unit < 0)
+					break;
+			}
+			else { //Striped or blocked, decided up front
+				if(i >= units.count)
+					break;
+				unit = i;
+				i += pol->blocks ? units.count : nodes;
+			}
+			t = MPI_Wtime();
+			render_tile(view, orbit, units.x0[unit], units.y0[unit], units.w[unit], units.h[unit], tile);
+			stats->compute += MPI_Wtime() - t;
+			t = MPI_Wtime();
+			memcpy(packet, &unit, sizeof(int));
+			packetSize = sizeof(int) + lc_encode(tile, units.w[unit] * units.h[unit], view->maxIter, packet + sizeof(int));
+			MPI_Send(packet, packetSize, MPI_BYTE, 0, RESULT_TAG, comm);
+			stats->comm += MPI_Wtime() - t;
+			stats->messages += 1;
+			stats->bytes += packetSize;
+		}
+	}
+	MPI_Bcast(&wall, 1, MPI_DOUBLE, 0, comm);
+	if(rank != 0 && wall > stats->compute + stats->comm + stats->idle) //Whatever else passed before the master finished was spent waiting
+		stats->idle = wall - stats->compute - stats->comm;
+	free(packet);
+	free(tile);
+	free_units(&units);
+	return wall;
+}
+
+static void split_args(const char *args, char *storage, char **argv, int *argc) { //Turns a view's command line into argv for parse_view
+	char *p;
+	strcpy(storage, args);
+	*argc = 1;
+	argv[0] = "bench";
+	for(p=strtok(storage, " ");p;p=strtok(NULL, " "))
+		argv[(*argc)++] = p;
+}
+
+int main(int argc, char *argv[])
+{
+	int rank, worldSize, i, v, n, pi, rep, reps = 3, width = BENCH_SIZE, height = BENCH_SIZE, maxRanks, first = 1;
+	const char *prefix = "bench_mandelbrot";
+	char name[1024];
+	FILE *csv = NULL, *json = NULL;
+
+	MPI_Init(&argc, &argv);
+	MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	maxRanks = worldSize;
+	for(i=1;i<argc;++i) {
+		if(strcmp(argv[i], "-s") == 0 && i + 2 < argc) {
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			reps = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			maxRanks = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			prefix = argv[++i];
+		else {
+			if(rank == 0)
+				fprintf(stderr, "Usage: %s [-s width height] [-r repeats] [-n maxranks] [-o prefix]\n", argv[0]);
+			MPI_Finalize();
+			return 1;
+		}
+	}
+	if(maxRanks > worldSize || maxRanks < 1)
+		maxRanks = worldSize;
+	if(reps < 1)
+		reps = 1;
+
+	if(rank == 0) {
+		snprintf(name, sizeof(name), "%s.csv", prefix);
+		csv = fopen(name, "w");
+		snprintf(name, sizeof(name), "%s.json", prefix);
+		json = fopen(name, "w");
+		if(!csv || !json) {
+			fprintf(stderr, "Cannot write results to %s.csv and %s.json\n", prefix, prefix);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		fprintf(csv, "view,policy,ranks,width,height,max_iter,deep,repeat,wall_s,mpixels_s,speedup,imbalance,worker_compute_max_s,worker_compute_mean_s,idle_total_s,comm_total_s,messages,bytes,correct\n");
+		fprintf(json, "{\"width\": %d, \"height\": %d, \"repeats\": %d, \"runs\": [", width, height, reps);
+		printf("%-9s %-15s %5s %10s %9s %8s %9s %8s %10s %s\n", "view", "policy", "ranks", "wall s", "Mpix/s", "speedup", "imbalance", "messages", "bytes", "ok");
+	}
+
+	for(v=0;v<(int)(sizeof(views) / sizeof(views[0]));++v) {
+		char storage[256], *viewArgv[32], size[2][16];
+		int viewArgc;
+		mandelview view;
+		dzorbit orbit = {0};
+		int *image = NULL, *reference = NULL, *tileReference = NULL;
+		double serialWall = 0;
+		long pixels;
+
+		split_args(views[v].args, storage, viewArgv, &viewArgc);
+		snprintf(size[0], sizeof(size[0]), "%d", width);
+		snprintf(size[1], sizeof(size[1]), "%d", height);
+		viewArgv[viewArgc++] = "-s";
+		viewArgv[viewArgc++] = size[0];
+		viewArgv[viewArgc++] = size[1];
+		if(!parse_view(viewArgc, viewArgv, &view)) {
+			if(rank == 0)
+				fprintf(stderr, "Bad benchmark view %s\n", views[v].name);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		pixels = (long)view.width * view.height;
+		if(view.deep) { //Shared by every run of the view, so it is not timed
+			if(rank == 0)
+				dz_reference_orbit(view.anchorRe, view.anchorIm, view.pixelSize, view.maxIter, &orbit);
+			dz_bcast_orbit(&orbit, 0, MPI_COMM_WORLD);
+		}
+		if(rank == 0) {
+			image = malloc(pixels * sizeof(int));
+			reference = malloc(pixels * sizeof(int));
+			tileReference = malloc(pixels * sizeof(int));
+			serialWall = MPI_Wtime(); //Single rank reference, also the base for the speedup
+			render_tile(&view, &orbit, 0, 0, view.width, view.height, reference);
+			serialWall = MPI_Wtime() - serialWall;
+			for(pi=0;pi<(int)(sizeof(policies) / sizeof(policies[0]));++pi)
+				if(policies[pi].tile) { //Tiled policies all share BENCH_TILE
+					unitlist units;
+					make_units(&view, &policies[pi], 1, &units);
+					render_units(&view, &orbit, &units, tileReference);
+					free_units(&units);
+				}
+			printf("%-9s %-15s %5d %10.4f %9.2f %8.2f %9s %8d %10d %s\n", views[v].name, "serial", 1, serialWall, pixels / serialWall / 1e6, 1.0, "-", 0, 0, "yes");
+			fprintf(csv, "%s,serial,1,%d,%d,%d,%d,0,%f,%f,1,1,%f,%f,0,0,0,0,1\n", views[v].name, view.width, view.height, view.maxIter, view.deep, serialWall, pixels / serialWall / 1e6, serialWall, serialWall);
+		}
+
+		for(n=2;n<=maxRanks;n=n*2>maxRanks ? maxRanks : n*2) { //Powers of two, then every rank
+			MPI_Comm comm;
+			MPI_Comm_split(MPI_COMM_WORLD, rank < n ? 0 : MPI_UNDEFINED, rank, &comm);
+			for(pi=0;pi<(int)(sizeof(policies) / sizeof(policies[0]));++pi)
+				for(rep=0;rep<reps;++rep) {
+					rankstats stats, *all = NULL;
+					double wall;
+					if(comm == MPI_COMM_NULL)
+						continue;
+					if(rank == 0) {
+						all = malloc(n * sizeof(rankstats));
+						memset(image, 0, pixels * sizeof(int));
+					}
+					wall = run_policy(comm, &view, &orbit, &policies[pi], image, &stats);
+					MPI_Gather(&stats, sizeof(rankstats), MPI_BYTE, all, sizeof(rankstats), MPI_BYTE, 0, comm);
+					if(rank == 0) {
+						double computeMax = 0, computeSum = 0, idle = 0, commTotal = 0, messages = 0, bytes = 0;
+						int correct = memcmp(image, policies[pi].tile ? tileReference : reference, pixels * sizeof(int)) == 0;
+						for(i=0;i<n;++i) {
+							if(i > 0) {
+								computeSum += all[i].compute;
+								if(all[i].compute > computeMax)
+									computeMax = all[i].compute;
+							}
+							idle += all[i].idle;
+							commTotal += all[i].comm;
+							messages += all[i].messages;
+							bytes += all[i].bytes;
+						}
+						printf("%-9s %-15s %5d %10.4f %9.2f %8.2f %9.2f %8.0f %10.0f %s\n", views[v].name, policies[pi].name, n, wall, pixels / wall / 1e6, serialWall / wall,
+							computeSum > 0 ? computeMax / (computeSum / (n - 1)) : 1, messages, bytes, correct ? "yes" : "NO");
+						fprintf(csv, "%s,%s,%d,%d,%d,%d,%d,%d,%f,%f,%f,%f,%f,%f,%f,%f,%.0f,%.0f,%d\n", views[v].name, policies[pi].name, n, view.width, view.height, view.maxIter, view.deep, rep,
+							wall, pixels / wall / 1e6, serialWall / wall, computeSum > 0 ? computeMax / (computeSum / (n - 1)) : 1, computeMax, computeSum / (n - 1), idle, commTotal, messages, bytes, correct);
+						fprintf(json, "%s\n  {\"view\": \"%s\", \"policy\": \"%s\", \"ranks\": %d, \"max_iter\": %d, \"deep\": %d, \"repeat\": %d, \"wall_s\": %f, \"mpixels_s\": %f, \"correct\": %s, \"per_rank\": [",
+							first ? "" : ",", views[v].name, policies[pi].name, n, view.maxIter, view.deep, rep, wall, pixels / wall / 1e6, correct ? "true" : "false");
+						first = 0;
+						for(i=0;i<n;++i)
+							fprintf(json, "%s{\"rank\": %d, \"compute_s\": %f, \"idle_s\": %f, \"comm_s\": %f, \"messages\": %.0f, \"bytes\": %.0f}", i ? ", " : "", i,
+								all[i].compute, all[i].idle, all[i].comm, all[i].messages, all[i].bytes);
+						fprintf(json, "]}");
+						free(all);
+					}
+				}
+			if(comm != MPI_COMM_NULL)
+				MPI_Comm_free(&comm);
+			MPI_Barrier(MPI_COMM_WORLD);
+			if(n == maxRanks)
+				break;
+		}
+		free(image);
+		free(reference);
+		free(tileReference);
+		free(orbit.re);
+		free(orbit.im);
+	}
+
+	if(rank == 0) {
+		fprintf(json, "\n]}\n");
+		fclose(csv);
+		fclose(json);
+		printf("Results written to %s.csv and %s.json\n", prefix, prefix);
+	}
+	MPI_Finalize();
+	return 0;
+}
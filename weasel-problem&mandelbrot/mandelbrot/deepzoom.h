@@ -0,0 +1,218 @@
+#ifndef DEEPZOOM_H
+#define DEEPZOOM_H
+
+/* Deep zoom engine using perturbation theory.
+ * One reference orbit Z_n is iterated at the view centre in multi-limb fixed point
+ * and stored as doubles. Every pixel then iterates only its offset dz from that orbit:
+ *     dz' = 2*Z_n*dz + dz^2 + dc
+ * which stays representable in a double down to pixel sizes of about 1e-300.
+ * When |Z_n + dz| drops below |dz| the delta has lost precision relative to the full
+ * value (a glitch), so the pixel is rebased onto the start of the orbit with dz = Z_n + dz. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <mpi.h>
+
+#define DZ_MAX_LIMBS 40 //32-bit limbs, enough for 1280 bits or a zoom of about 1e360
+#define DZ_GUARD_BITS 64 //Extra precision kept below the pixel size
+
+typedef struct { //Signed fixed point number, limb[0] is least significant, limb[n-1] is the integer part
+	int negative;
+	uint32_t limb[DZ_MAX_LIMBS];
+} dzfixed;
+
+typedef struct { //Reference orbit shared by every rank
+	int length; //Number of stored points, Z_0 = 0 up to the escape or maxIter
+	int escaped; //Non-zero if the reference left the set before maxIter
+	double *re, *im;
+} dzorbit;
+
+static int dzLimbs = 4; //Limbs in use for the current zoom
+
+static inline int dz_limbs_for(double pixelSize) { //Number of limbs needed to resolve a pixel of this size
+	int bits = (int)(-log2(pixelSize)) + DZ_GUARD_BITS, limbs = bits / 32 + 2;
+	if(limbs < 3)
+		limbs = 3;
+	if(limbs > DZ_MAX_LIMBS) {
+		fprintf(stderr, "Zoom too deep for %d limbs, precision will be limited\n", DZ_MAX_LIMBS);
+		limbs = DZ_MAX_LIMBS;
+	}
+	return limbs;
+}
+
+static inline int dz_cmp_mag(const dzfixed *a, const dzfixed *b) { //Compares |a| and |b|
+	int i;
+	for(i=dzLimbs-1;i>=0;--i)
+		if(a->limb[i] != b->limb[i])
+			return a->limb[i] > b->limb[i] ? 1 : -1;
+	return 0;
+}
+
+static inline void dz_add_mag(const dzfixed *a, const dzfixed *b, dzfixed *r) { //|r| = |a| + |b|
+	int i;
+	uint64_t carry = 0;
+	for(i=0;i<dzLimbs;++i) {
+		carry += (uint64_t)a->limb[i] + b->limb[i];
+		r->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+}
+
+static inline void dz_sub_mag(const dzfixed *a, const dzfixed *b, dzfixed *r) { //|r| = |a| - |b|, requires |a| >= |b|
+	int i;
+	int64_t borrow = 0;
+	for(i=0;i<dzLimbs;++i) {
+		int64_t t = (int64_t)a->limb[i] - b->limb[i] - borrow;
+		borrow = t < 0;
+		r->limb[i] = (uint32_t)t;
+	}
+}
+
+static inline void dz_add(const dzfixed *a, const dzfixed *b, dzfixed *r) { //r = a + b, r may alias a or b
+	if(a->negative == b->negative) {
+		r->negative = a->negative;
+		dz_add_mag(a, b, r);
+	}
+	else if(dz_cmp_mag(a, b) >= 0) {
+		r->negative = a->negative;
+		dz_sub_mag(a, b, r);
+	}
+	else {
+		r->negative = b->negative;
+		dz_sub_mag(b, a, r);
+	}
+}
+
+static inline void dz_mul(const dzfixed *a, const dzfixed *b, dzfixed *r) { //r = a * b truncated to dzLimbs, r may alias a or b
+	uint32_t product[2 * DZ_MAX_LIMBS] = {0};
+	int i, j, n = dzLimbs;
+	for(i=0;i<n;++i) {
+		uint64_t carry = 0;
+		if(a->limb[i] == 0)
+			continue;
+		for(j=0;j<n;++j) {
+			carry += (uint64_t)a->limb[i] * b->limb[j] + product[i + j];
+			product[i + j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		product[i + n] = (uint32_t)carry;
+	}
+	r->negative = a->negative ^ b->negative;
+	for(i=0;i<n;++i) //Drop the n-1 extra fractional limbs of the product
+		r->limb[i] = product[i + n - 1];
+}
+
+static inline void dz_from_string(const char *str, dzfixed *r) { //Parses a plain decimal like -0.7436438870371587 into fixed point
+	dzfixed fraction;
+	const char *frac, *p;
+	int i;
+	memset(r, 0, sizeof(dzfixed));
+	memset(&fraction, 0, sizeof(dzfixed));
+	while(*str == ' ')
+		++str;
+	if(*str == '-' || *str == '+')
+		r->negative = *str++ == '-';
+	r->limb[dzLimbs - 1] = (uint32_t)strtoul(str, NULL, 10);
+
+	frac = strchr(str, '.');
+	if(frac == NULL)
+		return;
+	for(p=frac+1;*p >= '0' && *p <= '9';++p) //Find the end of the fractional digits
+		;
+	for(--p;p>frac;--p) { //Horner from the last digit: f = (digit + f) / 10
+		uint64_t rem = 0;
+		fraction.limb[dzLimbs - 1] = *p - '0';
+		for(i=dzLimbs-1;i>=0;--i) {
+			uint64_t cur = (rem << 32) | fraction.limb[i];
+			fraction.limb[i] = (uint32_t)(cur / 10);
+			rem = cur % 10;
+		}
+	}
+	dz_add_mag(r, &fraction, r);
+}
+
+static inline double dz_to_double(const dzfixed *a) {
+	int i;
+	double value = 0, scale = 1;
+	for(i=dzLimbs-1;i>=0 && i>=dzLimbs-3;--i) { //Three limbs cover a double's mantissa
+		value += a->limb[i] * scale;
+		scale /= 4294967296.0;
+	}
+	return a->negative ? -value : value;
+}
+
+static inline void dz_reference_orbit(const char *centreRe, const char *centreIm, double pixelSize, int maxIter, dzorbit *orbit) { //Iterates the centre in full precision
+	dzfixed cr, ci, zr, zi, zr2, zi2, zri;
+	int n;
+	dzLimbs = dz_limbs_for(pixelSize);
+	dz_from_string(centreRe, &cr);
+	dz_from_string(centreIm, &ci);
+	memset(&zr, 0, sizeof(dzfixed));
+	memset(&zi, 0, sizeof(dzfixed));
+
+	orbit->re = malloc((maxIter + 1) * sizeof(double));
+	orbit->im = malloc((maxIter + 1) * sizeof(double));
+	orbit->escaped = 0;
+	for(n=0;n<=maxIter;++n) {
+		double re = dz_to_double(&zr), im = dz_to_double(&zi);
+		orbit->re[n] = re;
+		orbit->im[n] = im;
+		if(re * re + im * im > 4.0) {
+			orbit->escaped = 1;
+			++n;
+			break;
+		}
+		dz_mul(&zr, &zr, &zr2);
+		dz_mul(&zi, &zi, &zi2);
+		dz_mul(&zr, &zi, &zri);
+		zi2.negative = !zi2.negative; //zr = zr^2 - zi^2 + cr
+		dz_add(&zr2, &zi2, &zr);
+		dz_add(&zr, &cr, &zr);
+		dz_add(&zri, &zri, &zi); //zi = 2*zr*zi + ci
+		dz_add(&zi, &ci, &zi);
+	}
+	orbit->length = n;
+}
+
+static inline void dz_bcast_orbit(dzorbit *orbit, int root, MPI_Comm comm) { //Sends the reference orbit from root to every rank
+	int rank, header[2];
+	MPI_Comm_rank(comm, &rank);
+	header[0] = orbit->length;
+	header[1] = orbit->escaped;
+	MPI_Bcast(header, 2, MPI_INT, root, comm);
+	if(rank != root) {
+		orbit->length = header[0];
+		orbit->escaped = header[1];
+		orbit->re = malloc(orbit->length * sizeof(double));
+		orbit->im = malloc(orbit->length * sizeof(double));
+	}
+	MPI_Bcast(orbit->re, orbit->length, MPI_DOUBLE, root, comm);
+	MPI_Bcast(orbit->im, orbit->length, MPI_DOUBLE, root, comm);
+}
+
+static inline int dz_pixel(const dzorbit *orbit, double dcr, double dci, int max) { //Escape count for the pixel at offset dc from the reference
+	double dzr = 0, dzi = 0, zr, zi, temp, lengthsq;
+	const double *Zr = orbit->re, *Zi = orbit->im;
+	int count = 0, m = 0, last = orbit->length - 1;
+	do {
+		temp = 2 * (Zr[m] * dzr - Zi[m] * dzi) + dzr * dzr - dzi * dzi + dcr;
+		dzi = 2 * (Zr[m] * dzi + Zi[m] * dzr) + 2 * dzr * dzi + dci;
+		dzr = temp;
+		++m;
+		zr = Zr[m] + dzr;
+		zi = Zi[m] + dzi;
+		lengthsq = zr * zr + zi * zi;
+		count++;
+		if(lengthsq < dzr * dzr + dzi * dzi || m == last) { //Glitch or end of the reference, rebase onto Z_0 = 0
+			dzr = zr;
+			dzi = zi;
+			m = 0;
+		}
+	} while((lengthsq < 4.0) && (count < max));
+	return count;
+}
+
+#endif
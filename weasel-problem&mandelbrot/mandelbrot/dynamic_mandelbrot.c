@@ -1,191 +1,323 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 
 #include <X11/Xlib.h> //X11 library headers
 #include <X11/Xutil.h>
 #include <X11/Xos.h>
 
-#define X_RESN 1000 //X resolution
-#define Y_RESN 1000 //Y resolution
-#define REAL_MAX 2 //Real and imaginary ranges for the complex numbers
-#define REAL_MIN -2
-#define IMAG_MAX 2
-#define IMAG_MIN -2
+#include "view.h"
+#include "deepzoom.h"
+#include "linecodec.h"
+#include "render.h"
+#include "tilefile.h"
+#include "tilecache.h"
+#include "sequence.h"
+#include "x11window.h"
 
-typedef struct { //Complex number struct
-	float real, imaginary;
-} complex;
-
-Display* x11setup(Window *win, GC *gc, int width, int height); //Function prototype
-
-int cal_pixel(complex c) {
-  int count, max;
-  complex z;
-  float temp, lengthsq;
-  max = 256; //Maximum number of iterations to do
-  z.real = 0; z.imaginary = 0; //Initialise value of complex struct
-  count = 0; //Current number of iterations
-  do {
-	temp = z.real * z.real - z.imaginary * z.imaginary + c.real;
-    z.imaginary = 2 * z.real * z.imaginary + c.imaginary;
-    z.real = temp;
-    lengthsq = z.real * z.real + z.imaginary * z.imaginary;
-    count++;
-  } while ((lengthsq < 4.0) && (count < max));
-  return count;
-}
+void sequence_master(const mandelview *view, const seqframe *frames, int worldSize);
 
 int main(int argc, char *argv[])
 {
-	int rank, worldSize, i, j, x, y;
+	int rank, worldSize, i, j;
+	unsigned int x, y; //Pixel, counted up to the unsigned window size
 	double time;
-	unsigned int width = X_RESN, height = Y_RESN; //Window size
-	Window win; //Initialization for a window
-	GC gc; //Graphics context
+	unsigned int width, height; //Window size
+	Window win = 0; //Initialization for a window
+	GC gc = NULL; //Graphics context
 	Display *display = NULL;
+	mandelview view; //Region, size, iteration limit and output from the command line
+	dzorbit orbit = {0}; //Deep zoom reference orbit
+	int unit, x0, y0, w, h, packetSize, packetBytes;
+	int *tile; //Counts for one work unit
+	seqframe *frames = NULL; //Every frame of an animation
 	
 	MPI_Init(&argc, &argv); 
 	MPI_Comm_size(MPI_COMM_WORLD, &worldSize); 
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	
+	if(!parse_view(argc, argv, &view)) {
+		if(rank==0)
+			view_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+	if(view.sequence && !seq_load(&view, &frames, rank==0)) { //Every rank builds the same frames from the keyframes
+		MPI_Finalize();
+		return 1;
+	}
+	width = view.width;
+	height = view.height;
+	packetBytes = sizeof(int) + LC_MAX_BYTES(view.tileW * view.tileH); //Unit number followed by the encoded unit
+	tile = malloc((size_t)view.tileW * view.tileH * sizeof(int));
+	if(view.deep) { //The master computes the reference orbit once and every worker perturbs from it
+		if(rank==0) {
+			dz_reference_orbit(view.anchorRe, view.anchorIm, view.pixelSize, view.maxIter, &orbit);
+			if(orbit.escaped)
+				printf("Warning: reference escaped after %d iterations, pick a centre closer to the set\n", orbit.length - 1);
+		}
+		dz_bcast_orbit(&orbit, 0, MPI_COMM_WORLD);
+	}
         
-	if(rank==0) //Master node operations
+	if(rank==0 && view.sequence) //Master node operations for an animation
+		sequence_master(&view, frames, worldSize);
+	else if(rank==0) //Master node operations
 	{
-		int mandelbrot[Y_RESN][X_RESN] = {0}; //2D array to store the mandelbrot pixel values into
-		int imageLine, currentLine = 0, running = 1;
-		MPI_Status stat;
+		int *mandelbrot = NULL; //Whole image of pixel values, only kept when drawing to a window
+		int nextUnit = 0, received = 0, running = 1, nodes = worldSize - 1, done, node, stop = -1;
+		unsigned char *packets = malloc((size_t)nodes * packetBytes); //One receive buffer per worker
+		int *outstanding = calloc(nodes, sizeof(int)), *stopped = calloc(nodes, sizeof(int)); //Units assigned but not yet returned, and whether the stop was sent
+		int *completed = malloc(nodes * sizeof(int));
+		MPI_Request *requests = malloc(nodes * sizeof(MPI_Request));
+		MPI_Status *stats = malloc(nodes * sizeof(MPI_Status));
+		long wireBytes = 0, rawBytes = 0; //Bytes received against what the old int per pixel format would send
+		tilewriter writer;
+		tilecache cache;
+		int *missing = malloc(view.tiles * sizeof(int)), missingCount = 0; //Units the cache could not supply, the only ones handed out
+		double *lastArrival = malloc(nodes * sizeof(double)), cacheTime = 0, computeSeconds = 0; //When each worker last delivered, to time its tiles
 		
-		display = x11setup(&win, &gc, width, height);
+		if(view.output) { //Stream tiles to disk, memory stays bounded by the reorder window
+			if(!tw_open(&writer, &view))
+				MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		else {
+			mandelbrot = calloc((size_t)width * height, sizeof(int));
+			display = x11setup(&win, &gc, width, height);
+		}
 		time = MPI_Wtime(); //Get the start time
+		if(view.cacheDir) { //Fill in what earlier runs left behind
+			tc_init(&cache, &view);
+			for(i=0;i<view.tiles;++i) {
+				if(tc_lookup(&cache, i, tile))
+					tc_blit(&view, i, tile, mandelbrot);
+				else
+					missing[missingCount++] = i;
+			}
+			cacheTime = MPI_Wtime() - time;
+		}
+		else
+			for(missingCount=0;missingCount<view.tiles;++missingCount)
+				missing[missingCount] = missingCount;
+		for(node=0;node<nodes;++node)
+			lastArrival[node] = MPI_Wtime();
 		
-		for(i=0;i<Y_RESN + worldSize;++i) {
-			MPI_Recv(&imageLine, 1, MPI_INT, MPI_ANY_SOURCE, 1, MPI_COMM_WORLD, &stat); //Receive which line will be added
-			if(imageLine != -1) //If the node has computed a line, receive it
-				MPI_Recv(&(mandelbrot[imageLine]), X_RESN, MPI_INT, stat.MPI_SOURCE, 2, MPI_COMM_WORLD, &stat); //Receive mandelbrot line
-			MPI_Send(&currentLine, 1, MPI_INT, stat.MPI_SOURCE, 1, MPI_COMM_WORLD); //Send the node a new line to calculate
-			++currentLine;
+		for(node=0;node<nodes;++node) { //Give every worker its first depth units so the next one is always queued
+			for(j=0;j<view.depth && nextUnit<missingCount;++j) {
+				MPI_Send(&missing[nextUnit], 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+				++outstanding[node];
+				++nextUnit;
+			}
+			if(outstanding[node] == 0) { //More workers than units
+				MPI_Send(&stop, 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+				stopped[node] = 1;
+				requests[node] = MPI_REQUEST_NULL;
+			}
+			else
+				MPI_Irecv(packets + (size_t)node * packetBytes, packetBytes, MPI_BYTE, node + 1, 1, MPI_COMM_WORLD, &requests[node]);
+		}
+		
+		while(received < missingCount) { //Handle whichever workers have finished a unit
+			MPI_Waitsome(nodes, requests, &done, completed, stats);
+			for(i=0;i<done;++i) {
+				unsigned char *packet;
+				node = completed[i];
+				packet = packets + (size_t)node * packetBytes;
+				MPI_Get_count(&stats[i], MPI_BYTE, &packetSize);
+				memcpy(&unit, packet, sizeof(int)); //Which unit will be added
+				tile_rect(&view, unit, &x0, &y0, &w, &h);
+				if(view.cacheDir) { //Units are grid tiles, keep them for later runs and clip them into the image
+					double now = MPI_Wtime(), seconds = now - lastArrival[node]; //The worker's next unit was already queued, so the gap is this one's cost
+					lastArrival[node] = now;
+					computeSeconds += seconds;
+					w = view.tileW;
+					h = view.tileH;
+					lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, tile, w * h);
+					tc_store(&cache, unit, tile, seconds);
+					tc_blit(&view, unit, tile, mandelbrot);
+				}
+				else if(view.output) {
+					lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, tile, w * h);
+					tw_put(&writer, unit, tile, w, h);
+				}
+				else //Units are whole lines, decode straight into the image
+					lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, mandelbrot + (size_t)y0 * width, w * h);
+				wireBytes += packetSize;
+				rawBytes += (w * h + 1) * sizeof(int);
+				++received;
+				--outstanding[node];
+				
+				if(nextUnit < missingCount) { //Top the worker's queue back up
+					MPI_Send(&missing[nextUnit], 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+					++outstanding[node];
+					++nextUnit;
+				}
+				else if(!stopped[node]) { //Units ran out, the stop queues up behind the worker's remaining units
+					MPI_Send(&stop, 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+					stopped[node] = 1;
+				}
+				if(outstanding[node] > 0)
+					MPI_Irecv(packet, packetBytes, MPI_BYTE, node + 1, 1, MPI_COMM_WORLD, &requests[node]);
+			}
 		}
+		free(packets);
+		free(outstanding);
+		free(stopped);
+		free(completed);
+		free(requests);
+		free(stats);
+		free(lastArrival);
 		
 		time = MPI_Wtime() - time; //Get time taken to calculate the mandelbrot
 		printf("Calculation time took %f seconds\n", time); //Print elapsed time
+		printf("Bytes on wire: %ld (%ld as raw ints, %.1fx smaller)\n", wireBytes, rawBytes, wireBytes ? (double)rawBytes / wireBytes : 0);
 		
-		XClearWindow(display, win); //Clear window and draw the Mandelbrot
-		for(i=0;i<X_RESN;++i) {
-			for(j=0;j<Y_RESN;++j) {
-				if(mandelbrot[i][j]==256)
-					XDrawPoint(display, win, gc, j, i); //Draw point at i,j in white
-				XFlush(display);
-			}
+		if(view.cacheDir) {
+			int evicted = tc_evict(&cache);
+			printf("Cache: %d hits, %d derived from level %d, %d computed (%.1f%% hit rate) in %f seconds of lookups\n", cache.hits, cache.derived, view.level + 1, missingCount, 100.0 * (view.tiles - missingCount) / view.tiles, cacheTime);
+			printf("Cache saved about %f seconds of worker time (%f seconds of wall time), %d old tiles evicted\n", cache.secondsSaved, cache.secondsSaved / nodes, evicted);
+			if(missingCount)
+				printf("Computed tiles averaged %f seconds\n", computeSeconds / missingCount);
+			tc_free(&cache);
 		}
+		free(missing);
+		if(view.output) {
+			tw_close(&writer);
+			printf("Wrote %ld bytes of tiles to %s in %d writes, at most %d tiles buffered\n", writer.bytes, view.output, writer.writes, writer.peakBuffered);
+		}
+		else {
+			XClearWindow(display, win); //Clear window and draw the Mandelbrot
+			for(y=0;y<height;++y) {
+				for(x=0;x<width;++x) {
+					if(mandelbrot[(size_t)y * width + x]==view.maxIter)
+						XDrawPoint(display, win, gc, x, y); //Draw point at x,y in white
+					XFlush(display);
+				}
+			}
 
-		while(running) { //Wait for user to exit screen with keypress
-			if(XPending(display)) {
-				XEvent ev;
-				XNextEvent(display, &ev);
-				switch(ev.type) {
-					case KeyPress:
-						running = 0;
-						break;
+			while(running) { //Wait for user to exit screen with keypress
+				if(XPending(display)) {
+					XEvent ev;
+					XNextEvent(display, &ev);
+					switch(ev.type) {
+						case KeyPress:
+							running = 0;
+							break;
+					}
 				}
 			}
+			XCloseDisplay(display); //Close the display window
+			free(mandelbrot);
 		}
-		XCloseDisplay(display); //Close the display window
 	} //End master node operations
 	
 	else { //Slave node operations
-		complex c;
-		int line = -1;
-		float realStep = (float)(REAL_MAX - REAL_MIN) / X_RESN, imagStep = (float)(IMAG_MAX - IMAG_MIN) / Y_RESN; //Real and imaginary interpolation values
-		int mandelbrotLine[X_RESN] = {0}; //1D array to store line value into
+		int nextUnit, current = 0;
+		unsigned char *packets[2]; //Double buffered so one unit can be in flight while the next is encoded
+		MPI_Request recvRequest, sendRequests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
 		
-		while(line <= Y_RESN) {
-			MPI_Send(&line, 1, MPI_INT, 0, 1, MPI_COMM_WORLD); //Request new line
-			if(line >= 0) //If a line has previously been calculated send it back
-				MPI_Send(&mandelbrotLine, X_RESN, MPI_INT, 0, 2, MPI_COMM_WORLD);
-			MPI_Recv(&line, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE); //Receive a new line to calculate
-			if(line > Y_RESN) //If the image has been finished, breakout of the while and clean up
-				break;
-			c.real = -2; //Set real and imaginary parts of the complex number to start with
-			c.imaginary = 2 - (line * imagStep);
-			for(i=0;i<X_RESN;++i) { //Calculate every pixel in the line
-				mandelbrotLine[i] = cal_pixel(c);
-				c.real += realStep; //Increment the real value of the complex number
-			}
+		packets[0] = malloc(packetBytes);
+		packets[1] = malloc(packetBytes);
+		MPI_Recv(&unit, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE); //Receive the first unit to calculate
+		while(unit >= 0) { //A negative unit means the image has been finished
+			int n;
+			const mandelview *unitView = view.sequence ? &frames[unit / view.tiles].view : &view; //Animation units count on across frames
+			MPI_Irecv(&nextUnit, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &recvRequest); //The next assignment arrives while this unit is computed
+			n = render_unit(unitView, &orbit, unit % view.tiles, tile);
+			MPI_Wait(&sendRequests[current], MPI_STATUS_IGNORE); //Reuse the buffer once its previous unit has gone
+			memcpy(packets[current], &unit, sizeof(int)); //Send the unit number and encoded unit as one message
+			packetSize = sizeof(int) + lc_encode(tile, n, unitView->maxIter, packets[current] + sizeof(int));
+			MPI_Isend(packets[current], packetSize, MPI_BYTE, 0, 1, MPI_COMM_WORLD, &sendRequests[current]);
+			current ^= 1;
+			MPI_Wait(&recvRequest, MPI_STATUS_IGNORE);
+			unit = nextUnit;
 		}
+		MPI_Waitall(2, sendRequests, MPI_STATUSES_IGNORE);
+		free(packets[0]);
+		free(packets[1]);
 	} //End slave node operations
 	
+	free(tile);
+	free(frames);
 	MPI_Finalize();
 	return 0;
 }
 
-
-Display * x11setup(Window *win, GC *gc, int width, int height)
+void sequence_master(const mandelview *view, const seqframe *frames, int worldSize) //Hands out (frame, tile) units in order across several frames at once
 {
+	int nodes = worldSize - 1, total = view->frames * view->tiles, packetBytes = sizeof(int) + LC_MAX_BYTES(view->tileW * view->tileH);
+	int nextUnit = 0, received = 0, oldest = 0, stop = -1, written = 0, done, node, unit, packetSize, i, y;
+	unsigned char *packets = malloc((size_t)nodes * packetBytes); //One receive buffer per worker
+	int *outstanding = calloc(nodes, sizeof(int)), *stopped = calloc(nodes, sizeof(int)), *completed = malloc(nodes * sizeof(int));
+	int *tile = malloc((size_t)view->tileW * view->tileH * sizeof(int));
+	int *images = malloc((size_t)view->inFlight * view->width * view->height * sizeof(int)); //Frame f is drawn in slot f % inFlight
+	int *remaining = calloc(view->frames, sizeof(int)); //Tiles still to arrive per frame
+	MPI_Request *requests = malloc(nodes * sizeof(MPI_Request));
+	MPI_Status *stats = malloc(nodes * sizeof(MPI_Status));
+	double time = MPI_Wtime(), firstFrame = 0;
 	
-	/* --------------------------- X11 graphics setup ------------------------------ */
-	Display 		*display;
-	unsigned int 	win_x,win_y, /* window position */
-					border_width, /* border width in pixels */
-					display_width, display_height, /* size of screen */
-					screen; /* which screen */
-	
-	char 			window_name[] = "Mandelbrot", *display_name = NULL;
-	unsigned long 	valuemask = 0;
-	XGCValues 		values;
-	
-	XSizeHints 		size_hints;
-	
-	//Pixmap 		bitmap;
-	//XPoint 		points[800];
-	FILE 			*fopen ();//, *fp;
-	//char 			str[100];
-	
-	XSetWindowAttributes attr[1];
+	for(i=0;i<view->frames;++i)
+		remaining[i] = view->tiles;
+	for(node=0;node<nodes;++node)
+		requests[node] = MPI_REQUEST_NULL;
 	
-	if ( (display = XOpenDisplay (display_name)) == NULL ) { /* connect to Xserver */
-		fprintf (stderr, "Cannot connect to X server %s\n",XDisplayName (display_name) );
-		exit (-1);
-	}
-	
-	screen = DefaultScreen (display); /* get screen size */
-	display_width = DisplayWidth (display, screen);
-	display_height = DisplayHeight (display, screen);
-	
-	win_x = 0; win_y = 0; /* set window position */
-	
-	border_width = 4; /* create opaque window */
-	*win = XCreateSimpleWindow (display, RootWindow (display, screen),
-			win_x, win_y, width, height, border_width,
-			WhitePixel (display, screen), BlackPixel (display, screen));
+	while(received < total) {
+		for(node=0;node<nodes;++node) { //Keep every worker depth units ahead, as far as the frames in flight allow
+			while(outstanding[node] < view->depth && nextUnit < total && nextUnit / view->tiles < oldest + view->inFlight) {
+				MPI_Send(&nextUnit, 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+				++outstanding[node];
+				++nextUnit;
+			}
+			if(nextUnit == total && outstanding[node] == 0 && !stopped[node]) { //Units ran out, the stop queues up behind the worker's remaining units
+				MPI_Send(&stop, 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
+				stopped[node] = 1;
+			}
+			if(outstanding[node] > 0 && requests[node] == MPI_REQUEST_NULL)
+				MPI_Irecv(packets + (size_t)node * packetBytes, packetBytes, MPI_BYTE, node + 1, 1, MPI_COMM_WORLD, &requests[node]);
+		}
+		
+		MPI_Waitsome(nodes, requests, &done, completed, stats);
+		for(i=0;i<done;++i) {
+			const unsigned char *packet;
+			const mandelview *frame;
+			int *image, x0, y0, w, h, f;
+			node = completed[i];
+			packet = packets + (size_t)node * packetBytes;
+			MPI_Get_count(&stats[i], MPI_BYTE, &packetSize);
+			memcpy(&unit, packet, sizeof(int));
+			f = unit / view->tiles;
+			frame = &frames[f].view;
+			image = images + (size_t)(f % view->inFlight) * view->width * view->height;
+			tile_rect(frame, unit % view->tiles, &x0, &y0, &w, &h);
+			lc_decode(packet + sizeof(int), packetSize - sizeof(int), frame->maxIter, tile, w * h);
+			for(y=0;y<h;++y)
+				memcpy(image + (size_t)(y0 + y) * view->width + x0, tile + y * w, w * sizeof(int));
+			++received;
+			--outstanding[node];
 			
-	size_hints.flags = USPosition|USSize;
-	size_hints.x = win_x;
-	size_hints.y = win_y;
-	size_hints.width = width;
-	size_hints.height = height;
-	size_hints.min_width = 300;
-	size_hints.min_height = 300;
-	
-	XSetNormalHints (display, *win, &size_hints);
-	XStoreName(display, *win, window_name);
-	
-	*gc = XCreateGC (display, *win, valuemask, &values); /* create graphics context */
-	
-	XSetBackground (display, *gc, BlackPixel (display, screen));
-	XSetForeground (display, *gc, WhitePixel (display, screen));
-	XSetLineAttributes (display, *gc, 1, LineSolid, CapRound, JoinRound);
-	
-	attr[0].backing_store = Always;
-	attr[0].backing_planes = 1;
-	attr[0].backing_pixel = BlackPixel(display, screen);
-	
-	XChangeWindowAttributes(display, *win, CWBackingStore | CWBackingPlanes | CWBackingPixel, attr);
-	
-	XSelectInput(display, *win, KeyPressMask);
-	
-	XMapWindow (display, *win);
-	XSync(display, 0);
+			if(--remaining[f] == 0) { //Frame finished, write it and free its slot once the frames before it are out
+				written += seq_write_pgm(view->output, f, image, view->width, view->height, frame->maxIter);
+				if(f == 0)
+					firstFrame = MPI_Wtime() - time;
+				while(oldest < view->frames && remaining[oldest] == 0)
+					++oldest;
+			}
+		}
+	}
+	for(node=0;node<nodes;++node) //Workers whose last units finished the job still wait for a stop
+		if(!stopped[node])
+			MPI_Send(&stop, 1, MPI_INT, node + 1, 1, MPI_COMM_WORLD);
 	
-	/* --------------------------- End of X11 graphics setup ------------------------------ */
-	return display;
+	time = MPI_Wtime() - time;
+	printf("Rendered %d frames of %d x %d in %f seconds, %.2f frames per second (first frame after %f seconds)\n", view->frames, view->width, view->height, time, view->frames / time, firstFrame);
+	printf("Wrote %d frames to %s, at most %d frames in flight\n", written, view->output, view->inFlight);
+	free(packets);
+	free(outstanding);
+	free(stopped);
+	free(completed);
+	free(tile);
+	free(images);
+	free(remaining);
+	free(requests);
+	free(stats);
 }
\ No newline at end of file
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mpi.h>
+
+#include <X11/Xlib.h> //X11 library headers
+#include <X11/Xutil.h>
+#include <X11/Xos.h>
+
+#include "view.h"
+#include "deepzoom.h"
+#include "render.h"
+#include "x11window.h"
+
+//Every rank, the master included, computes with a pool of threads. Units start split evenly between ranks
+//and then between each rank's threads. A thread that runs dry steals half of another thread's deque, and
+//once a whole rank is dry its main thread steals half of the fullest deque of another rank. Only the main
+//thread calls MPI. When no rank has work left an MPI_Ibarrier completes and the finished units are gathered.
+
+#define STEAL_TAG 2 //Request for units from an idle rank
+#define GIVE_TAG 3 //Units handed over in reply, count first
+#define POLL_NANOSECONDS 50000 //Pause between polls of the main thread
+
+typedef struct { //Units owned by one thread, the owner works from the back and thieves take from the front
+	pthread_mutex_t lock;
+	int *units;
+	int head, tail, capacity;
+} deque;
+
+typedef struct {
+	const mandelview *view;
+	const dzorbit *orbit;
+	int *image; //Counts for the whole view, each rank fills in the units it computed
+	deque *deques; //One per thread
+	int threads;
+	pthread_mutex_t lock; //Guards the fields below
+	pthread_cond_t wake; //Signalled when units arrive from another rank or the image is finished
+	int idle, finished;
+	unsigned long generation; //Bumped whenever the main thread hands out units
+	int *done, doneCount; //Units computed on this rank in the order they finished
+	int localSteals;
+} pool;
+
+typedef struct {
+	pool *pool;
+	int id;
+} worker;
+
+static void dq_push(deque *dq, const int *units, int count) { //Adds units at the back
+	pthread_mutex_lock(&dq->lock);
+	if(dq->tail + count > dq->capacity) { //Slide the live units down over the ones stolen from the front
+		memmove(dq->units, dq->units + dq->head, (dq->tail - dq->head) * sizeof(int));
+		dq->tail -= dq->head;
+		dq->head = 0;
+	}
+	memcpy(dq->units + dq->tail, units, count * sizeof(int));
+	dq->tail += count;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+static int dq_pop(deque *dq, int *unit) { //Owner takes from the back, returns 0 when empty
+	int found = 0;
+	pthread_mutex_lock(&dq->lock);
+	if(dq->tail > dq->head) {
+		*unit = dq->units[--dq->tail];
+		found = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return found;
+}
+
+static int dq_steal(deque *dq, int *units, int keep) { //Takes half of what is queued from the front, leaving at least keep, returns how many
+	int count;
+	pthread_mutex_lock(&dq->lock);
+	count = (dq->tail - dq->head + 1) / 2;
+	if(dq->tail - dq->head - count < keep)
+		count = dq->tail - dq->head - keep;
+	if(count < 0)
+		count = 0;
+	memcpy(units, dq->units + dq->head, count * sizeof(int));
+	dq->head += count;
+	pthread_mutex_unlock(&dq->lock);
+	return count;
+}
+
+static int dq_size(deque *dq) {
+	int size;
+	pthread_mutex_lock(&dq->lock);
+	size = dq->tail - dq->head;
+	pthread_mutex_unlock(&dq->lock);
+	return size;
+}
+
+static int steal_local(pool *p, int self, int *buffer, int *unit) { //Refills this thread's deque from another thread's, returns 0 if every deque is empty
+	int i, count;
+	for(i=1;i<p->threads;++i) {
+		if((count = dq_steal(&p->deques[(self + i) % p->threads], buffer, 0)) > 0) {
+			dq_push(&p->deques[self], buffer, count);
+			pthread_mutex_lock(&p->lock);
+			++p->localSteals;
+			pthread_mutex_unlock(&p->lock);
+			return dq_pop(&p->deques[self], unit);
+		}
+	}
+	return 0;
+}
+
+static void *compute_thread(void *arg) { //Computes units until the main thread says the image is finished
+	worker *self = arg;
+	pool *p = self->pool;
+	const mandelview *view = p->view;
+	int *tile = malloc((size_t)view->tileW * view->tileH * sizeof(int)), *buffer = malloc(view->tiles * sizeof(int));
+	int unit, x0, y0, w, h, y;
+	unsigned long seen;
+
+	for(;;) {
+		pthread_mutex_lock(&p->lock);
+		seen = p->generation;
+		pthread_mutex_unlock(&p->lock);
+		if(dq_pop(&p->deques[self->id], &unit) || steal_local(p, self->id, buffer, &unit)) {
+			tile_rect(view, unit, &x0, &y0, &w, &h);
+			render_tile(view, p->orbit, x0, y0, w, h, tile);
+			for(y=0;y<h;++y)
+				memcpy(p->image + (size_t)(y0 + y) * view->width + x0, tile + y * w, w * sizeof(int));
+			pthread_mutex_lock(&p->lock);
+			p->done[p->doneCount++] = unit;
+			pthread_mutex_unlock(&p->lock);
+			continue;
+		}
+		pthread_mutex_lock(&p->lock);
+		if(p->finished) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		if(seen == p->generation) { //Nothing handed out since the deques were checked, sleep until there is
+			++p->idle;
+			pthread_cond_wait(&p->wake, &p->lock);
+			--p->idle;
+		}
+		pthread_mutex_unlock(&p->lock);
+	}
+	free(tile);
+	free(buffer);
+	return NULL;
+}
+
+static int queued(pool *p) { //Units waiting in every deque
+	int i, total = 0;
+	for(i=0;i<p->threads;++i)
+		total += dq_size(&p->deques[i]);
+	return total;
+}
+
+static void hand_out(pool *p, const int *units, int count) { //Spreads units from another rank over the threads and wakes them
+	int i, share = (count + p->threads - 1) / p->threads;
+	for(i=0;i<p->threads && i*share<count;++i)
+		dq_push(&p->deques[i], units + i * share, count - i * share < share ? count - i * share : share);
+	pthread_mutex_lock(&p->lock);
+	++p->generation;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static int give_away(pool *p, int *units) { //Takes half of the fullest deque for a thief, returns how many
+	int i, fullest = 0, size, best = 0;
+	for(i=0;i<p->threads;++i)
+		if((size = dq_size(&p->deques[i])) > best) {
+			best = size;
+			fullest = i;
+		}
+	return best > 1 ? dq_steal(&p->deques[fullest], units, 1) : 0; //The owner keeps one so it is not robbed of its next unit
+}
+
+int main(int argc, char *argv[])
+{
+	int rank, worldSize, provided, i, y;
+	double time, gatherTime;
+	unsigned int width, height; //Window size
+	Window win = 0; //Initialization for a window
+	GC gc = NULL; //Graphics context
+	Display *display = NULL;
+	mandelview view; //Region, size, iteration limit and threads from the command line
+	dzorbit orbit = {0}; //Deep zoom reference orbit
+	pool p;
+	worker *workers;
+	pthread_t *threads;
+	MPI_Comm node;
+	int localRanks, first, last, share, t;
+	int *reply, *gift, requesting = 0, failures = 0, victim, inBarrier = 0, remoteSteals = 0, given = 0, flag;
+	MPI_Request replyRequest, barrier;
+	MPI_Status stat;
+	struct timespec pause = {0, POLL_NANOSECONDS};
+
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); //Only the main thread talks to other ranks
+	MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	if(!parse_view(argc, argv, &view) || view.output || view.cacheDir) {
+		if(rank==0 && (view.output || view.cacheDir))
+			fprintf(stderr, "The hybrid driver only draws to a window\n");
+		else if(rank==0)
+			view_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+	if(provided < MPI_THREAD_FUNNELED && rank==0)
+		printf("Warning: MPI only provides thread level %d, continuing anyway\n", provided);
+	width = view.width;
+	height = view.height;
+	if(view.threads == 0) { //Share the node's cores between the ranks running on it
+		MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+		MPI_Comm_size(node, &localRanks);
+		MPI_Comm_free(&node);
+		view.threads = sysconf(_SC_NPROCESSORS_ONLN) / localRanks;
+		if(view.threads < 1)
+			view.threads = 1;
+	}
+	if(view.deep) { //The master computes the reference orbit once and every rank perturbs from it
+		if(rank==0) {
+			dz_reference_orbit(view.anchorRe, view.anchorIm, view.pixelSize, view.maxIter, &orbit);
+			if(orbit.escaped)
+				printf("Warning: reference escaped after %d iterations, pick a centre closer to the set\n", orbit.length - 1);
+		}
+		dz_bcast_orbit(&orbit, 0, MPI_COMM_WORLD);
+	}
+
+	memset(&p, 0, sizeof(pool));
+	p.view = &view;
+	p.orbit = &orbit;
+	p.threads = view.threads;
+	p.image = calloc((size_t)width * height, sizeof(int));
+	p.done = malloc(view.tiles * sizeof(int));
+	p.deques = calloc(p.threads, sizeof(deque));
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.wake, NULL);
+	reply = malloc((view.tiles + 1) * sizeof(int)); //Where a steal lands, it may be pending while this rank serves others
+	gift = malloc((view.tiles + 1) * sizeof(int)); //What this rank hands to thieves
+	first = (long)view.tiles * rank / worldSize; //This rank's even share to start with
+	last = (long)view.tiles * (rank + 1) / worldSize;
+	share = (last - first + p.threads - 1) / p.threads;
+	for(t=0;t<p.threads;++t) {
+		deque *dq = &p.deques[t];
+		pthread_mutex_init(&dq->lock, NULL);
+		dq->capacity = view.tiles;
+		dq->units = malloc(view.tiles * sizeof(int));
+		for(i=first+(t+1)*share-1;i>=first+t*share;--i) //Reversed, so the owner pops its range in order
+			if(i < last)
+				dq->units[dq->tail++] = i;
+	}
+
+	if(rank==0)
+		display = x11setup(&win, &gc, width, height);
+	MPI_Barrier(MPI_COMM_WORLD);
+	time = MPI_Wtime(); //Get the start time
+
+	workers = malloc(p.threads * sizeof(worker));
+	threads = malloc(p.threads * sizeof(pthread_t));
+	for(t=0;t<p.threads;++t) {
+		workers[t].pool = &p;
+		workers[t].id = t;
+		pthread_create(&threads[t], NULL, compute_thread, &workers[t]);
+	}
+
+	victim = (rank + 1) % worldSize;
+	while(1) { //Serve thieves, steal when this rank runs dry, and stop once every rank has
+		int dry;
+		MPI_Iprobe(MPI_ANY_SOURCE, STEAL_TAG, MPI_COMM_WORLD, &flag, &stat);
+		while(flag) {
+			int thief = stat.MPI_SOURCE, count;
+			MPI_Recv(NULL, 0, MPI_INT, thief, STEAL_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			count = give_away(&p, gift + 1);
+			gift[0] = count;
+			given += count;
+			MPI_Send(gift, count + 1, MPI_INT, thief, GIVE_TAG, MPI_COMM_WORLD);
+			MPI_Iprobe(MPI_ANY_SOURCE, STEAL_TAG, MPI_COMM_WORLD, &flag, &stat);
+		}
+
+		if(requesting) {
+			MPI_Test(&replyRequest, &flag, MPI_STATUS_IGNORE);
+			if(flag) {
+				requesting = 0;
+				if(reply[0] > 0) {
+					hand_out(&p, reply + 1, reply[0]);
+					remoteSteals += reply[0];
+					failures = 0;
+				}
+				else {
+					++failures;
+					victim = (victim + 1) % worldSize;
+					if(victim == rank)
+						victim = (victim + 1) % worldSize;
+				}
+			}
+		}
+
+		pthread_mutex_lock(&p.lock);
+		dry = p.idle == p.threads;
+		pthread_mutex_unlock(&p.lock);
+		if(dry && queued(&p) == 0 && !requesting && !inBarrier) {
+			if(failures < worldSize - 1) { //Ask the next rank for some of its units
+				MPI_Send(NULL, 0, MPI_INT, victim, STEAL_TAG, MPI_COMM_WORLD);
+				MPI_Irecv(reply, view.tiles + 1, MPI_INT, victim, GIVE_TAG, MPI_COMM_WORLD, &replyRequest);
+				requesting = 1;
+			}
+			else { //Every other rank was dry too, units never come back so this rank is done
+				MPI_Ibarrier(MPI_COMM_WORLD, &barrier);
+				inBarrier = 1;
+			}
+		}
+		if(inBarrier) {
+			MPI_Test(&barrier, &flag, MPI_STATUS_IGNORE);
+			if(flag)
+				break;
+		}
+		nanosleep(&pause, NULL);
+	}
+
+	pthread_mutex_lock(&p.lock);
+	p.finished = 1;
+	pthread_cond_broadcast(&p.wake);
+	pthread_mutex_unlock(&p.lock);
+	for(t=0;t<p.threads;++t)
+		pthread_join(threads[t], NULL);
+	time = MPI_Wtime() - time;
+	gatherTime = MPI_Wtime();
+
+	{ //Gather every rank's finished units into the master's image
+		int pixels = 0, *sendPixels, *unitCounts = NULL, *unitDispls = NULL, *pixelCounts = NULL, *pixelDispls = NULL, *units = NULL, *staging = NULL;
+		int stats[4] = {p.doneCount, p.localSteals, remoteSteals, given}, *allStats = NULL, x0, y0, w, h, offset;
+		for(i=0;i<p.doneCount;++i) {
+			tile_rect(&view, p.done[i], &x0, &y0, &w, &h);
+			pixels += w * h;
+		}
+		sendPixels = malloc((pixels ? pixels : 1) * sizeof(int));
+		for(i=0,offset=0;i<p.doneCount;++i) {
+			tile_rect(&view, p.done[i], &x0, &y0, &w, &h);
+			for(y=0;y<h;++y)
+				memcpy(sendPixels + offset + y * w, p.image + (size_t)(y0 + y) * width + x0, w * sizeof(int));
+			offset += w * h;
+		}
+		if(rank==0) {
+			unitCounts = malloc(worldSize * sizeof(int));
+			unitDispls = malloc(worldSize * sizeof(int));
+			pixelCounts = malloc(worldSize * sizeof(int));
+			pixelDispls = malloc(worldSize * sizeof(int));
+			allStats = malloc(4 * worldSize * sizeof(int));
+			units = malloc(view.tiles * sizeof(int));
+		}
+		MPI_Gather(stats, 4, MPI_INT, allStats, 4, MPI_INT, 0, MPI_COMM_WORLD);
+		MPI_Gather(&pixels, 1, MPI_INT, pixelCounts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		if(rank==0) {
+			for(i=0;i<worldSize;++i) {
+				unitCounts[i] = allStats[4 * i];
+				unitDispls[i] = i ? unitDispls[i - 1] + unitCounts[i - 1] : 0;
+				pixelDispls[i] = i ? pixelDispls[i - 1] + pixelCounts[i - 1] : 0;
+			}
+			if(unitDispls[worldSize - 1] + unitCounts[worldSize - 1] != view.tiles) { //A unit lost or done twice would leave holes or overrun the image
+				fprintf(stderr, "Ranks finished %d units of %d, giving up\n", unitDispls[worldSize - 1] + unitCounts[worldSize - 1], view.tiles);
+				MPI_Abort(MPI_COMM_WORLD, 1);
+			}
+			staging = malloc(((size_t)pixelDispls[worldSize - 1] + pixelCounts[worldSize - 1] + 1) * sizeof(int));
+		}
+		MPI_Gatherv(p.done, p.doneCount, MPI_INT, units, unitCounts, unitDispls, MPI_INT, 0, MPI_COMM_WORLD);
+		MPI_Gatherv(sendPixels, pixels, MPI_INT, staging, pixelCounts, pixelDispls, MPI_INT, 0, MPI_COMM_WORLD);
+		if(rank==0) {
+			for(i=unitCounts[0],offset=pixelCounts[0];i<view.tiles;++i) { //The master's own units are already in place
+				tile_rect(&view, units[i], &x0, &y0, &w, &h);
+				for(y=0;y<h;++y)
+					memcpy(p.image + (size_t)(y0 + y) * width + x0, staging + offset + y * w, w * sizeof(int));
+				offset += w * h;
+			}
+			gatherTime = MPI_Wtime() - gatherTime;
+			printf("Calculation time took %f seconds with %d ranks of %d threads, gathering took %f seconds\n", time, worldSize, p.threads, gatherTime);
+			for(i=0;i<worldSize;++i)
+				printf("Rank %d computed %d units, %d steals between its threads, took %d units from other ranks and gave away %d\n", i, allStats[4 * i], allStats[4 * i + 1], allStats[4 * i + 2], allStats[4 * i + 3]);
+			free(unitCounts);
+			free(unitDispls);
+			free(pixelCounts);
+			free(pixelDispls);
+			free(allStats);
+			free(units);
+			free(staging);
+		}
+		free(sendPixels);
+	}
+
+	if(rank==0) //Master draws the gathered image
+	{
+		int running = 1;
+		unsigned int px, py; //Pixel, counted up to the unsigned window size
+		XClearWindow(display, win); //Clear window and draw the Mandelbrot
+		for(py=0;py<height;++py) {
+			for(px=0;px<width;++px) {
+				if(p.image[(size_t)py * width + px]==view.maxIter)
+					XDrawPoint(display, win, gc, px, py); //Draw point at x,y in white
+				XFlush(display);
+			}
+		}
+
+		while(running) { //Wait for user to exit screen with keypress
+			if(XPending(display)) {
+				XEvent ev;
+				XNextEvent(display, &ev);
+				switch(ev.type) {
+					case KeyPress:
+						running = 0;
+						break;
+				}
+			}
+		}
+		XCloseDisplay(display); //Close the display window
+	}
+
+	for(t=0;t<p.threads;++t) {
+		pthread_mutex_destroy(&p.deques[t].lock);
+		free(p.deques[t].units);
+	}
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.wake);
+	free(p.deques);
+	free(p.image);
+	free(p.done);
+	free(reply);
+	free(gift);
+	free(workers);
+	free(threads);
+	MPI_Finalize();
+	return 0;
+}
\ No newline at end of file
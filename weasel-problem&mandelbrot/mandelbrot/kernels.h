@@ -0,0 +1,111 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/* Escape-time kernels for every fractal, power and precision the drivers support.
+ * ESCAPE_KERNEL stamps out one row function per combination with the scalar type, the Julia switch and
+ * the power fixed at compile time, so the power loop unrolls and the unused branches fold away. A kernel
+ * fills w counts for pixels x0 .. x0 + w - 1 of row y, stepping the real part by one pixel each time.
+ * Window views start from the top left corner of the view, cache views from the grid's origin. PARSE
+ * reads the centre, strtold for the long double kernels so they start from every digit they can hold.
+ * kernel_for picks the instance matching the command line from the table at the bottom. */
+
+#include <stdlib.h>
+
+#include "view.h"
+
+typedef void (*kernelrow)(const mandelview *view, long long x0, long long y, int w, int *out);
+
+typedef struct {
+	const char *name; //Also part of the tile cache key, since kernels give different counts
+	int julia, power, precision;
+	kernelrow row;
+} kernelinfo;
+
+#define ESCAPE_KERNEL(NAME, T, PARSE, JULIA, POWER) \
+static void NAME(const mandelview *view, long long x0, long long y, int w, int *out) { \
+	T step = view->pixelSize, re, im, zr, zi, cr, ci, pr, pi, temp, lengthsq; \
+	int x, k, count, max = view->maxIter; \
+	if(view->cacheDir) { /* Grid anchored at the origin */ \
+		re = x0 * step; \
+		im = -y * step; \
+	} \
+	else { /* Top left corner of the view */ \
+		re = (T)(PARSE(view->centreRe, NULL) - (view->width / 2) * step) + x0 * step; \
+		im = (T)(PARSE(view->centreIm, NULL) + (view->height / 2) * step) - y * step; \
+	} \
+	for(x=0;x<w;++x) { \
+		if(JULIA) { /* The pixel is the starting point, the constant is fixed */ \
+			zr = re; \
+			zi = im; \
+			cr = view->juliaRe; \
+			ci = view->juliaIm; \
+		} \
+		else { \
+			zr = 0; \
+			zi = 0; \
+			cr = re; \
+			ci = im; \
+		} \
+		count = 0; \
+		do { \
+			if(POWER == 2) { \
+				temp = zr * zr - zi * zi + cr; \
+				zi = 2 * zr * zi + ci; \
+				zr = temp; \
+			} \
+			else { /* z^POWER by repeated multiplication */ \
+				pr = zr; \
+				pi = zi; \
+				for(k=1;k<POWER;++k) { \
+					temp = pr * zr - pi * zi; \
+					pi = pr * zi + pi * zr; \
+					pr = temp; \
+				} \
+				zr = pr + cr; \
+				zi = pi + ci; \
+			} \
+			lengthsq = zr * zr + zi * zi; \
+			count++; \
+		} while((lengthsq < 4.0) && (count < max)); \
+		out[x] = count; \
+		re += step; /* Increment the real value of the complex number */ \
+	} \
+}
+
+#define ESCAPE_POWERS(PREFIX, T, PARSE, JULIA) \
+	ESCAPE_KERNEL(PREFIX##_2, T, PARSE, JULIA, 2) \
+	ESCAPE_KERNEL(PREFIX##_3, T, PARSE, JULIA, 3) \
+	ESCAPE_KERNEL(PREFIX##_4, T, PARSE, JULIA, 4) \
+	ESCAPE_KERNEL(PREFIX##_5, T, PARSE, JULIA, 5)
+
+ESCAPE_POWERS(mandelbrot_float, float, strtod, 0)
+ESCAPE_POWERS(mandelbrot_double, double, strtod, 0)
+ESCAPE_POWERS(mandelbrot_long, long double, strtold, 0)
+ESCAPE_POWERS(julia_float, float, strtod, 1)
+ESCAPE_POWERS(julia_double, double, strtod, 1)
+ESCAPE_POWERS(julia_long, long double, strtold, 1)
+
+#define KERNEL_ENTRIES(PREFIX, JULIA, PRECISION) \
+	{#PREFIX "_2", JULIA, 2, PRECISION, PREFIX##_2}, \
+	{#PREFIX "_3", JULIA, 3, PRECISION, PREFIX##_3}, \
+	{#PREFIX "_4", JULIA, 4, PRECISION, PREFIX##_4}, \
+	{#PREFIX "_5", JULIA, 5, PRECISION, PREFIX##_5}
+
+static const kernelinfo kernels[] = {
+	KERNEL_ENTRIES(mandelbrot_float, 0, PRECISION_FLOAT),
+	KERNEL_ENTRIES(mandelbrot_double, 0, PRECISION_DOUBLE),
+	KERNEL_ENTRIES(mandelbrot_long, 0, PRECISION_LONG),
+	KERNEL_ENTRIES(julia_float, 1, PRECISION_FLOAT),
+	KERNEL_ENTRIES(julia_double, 1, PRECISION_DOUBLE),
+	KERNEL_ENTRIES(julia_long, 1, PRECISION_LONG)
+};
+
+static inline const kernelinfo *kernel_for(const mandelview *view) { //Compiled kernel for the view's fractal, power and precision
+	int i;
+	for(i=0;i<(int)(sizeof(kernels) / sizeof(kernels[0]));++i)
+		if(kernels[i].julia == (view->julia != 0) && kernels[i].power == view->power && kernels[i].precision == view->precision)
+			return &kernels[i];
+	return &kernels[0]; //parse_view only accepts combinations in the table
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef LINECODEC_H
+#define LINECODEC_H
+
+/* Compact wire format for finished lines of iteration counts.
+ * Counts are always 1..maxIter, so count - 1 is stored in 1, 2 or 4 bytes depending on maxIter.
+ * Values are grouped into packets with a one byte header (the PackBits scheme):
+ *   header 0..127    header + 1 literal values follow
+ *   header 128..255  the next value repeats header - 126 times (2..129) */
+
+#include <string.h>
+
+#define LC_MAX_LITERAL 128
+#define LC_MAX_RUN 129
+#define LC_MAX_BYTES(n) ((n) * 4 + ((n) + LC_MAX_LITERAL - 1) / LC_MAX_LITERAL) //Worst case encoded size of n values
+
+static inline int lc_value_bytes(int maxIter) { //Bytes needed per value for this iteration limit
+	if(maxIter <= 0x100)
+		return 1;
+	if(maxIter <= 0x10000)
+		return 2;
+	return 4;
+}
+
+static inline unsigned char *lc_put(unsigned char *out, int value, int valueBytes) {
+	unsigned int v = value - 1;
+	*out++ = v & 0xff;
+	if(valueBytes > 1)
+		*out++ = (v >> 8) & 0xff;
+	if(valueBytes > 2) {
+		*out++ = (v >> 16) & 0xff;
+		*out++ = (v >> 24) & 0xff;
+	}
+	return out;
+}
+
+static inline const unsigned char *lc_get(const unsigned char *in, int *value, int valueBytes) {
+	unsigned int v = *in++;
+	if(valueBytes > 1)
+		v |= (unsigned int)*in++ << 8;
+	if(valueBytes > 2) {
+		v |= (unsigned int)*in++ << 16;
+		v |= (unsigned int)*in++ << 24;
+	}
+	*value = (int)v + 1;
+	return in;
+}
+
+static inline int lc_encode(const int *values, int n, int maxIter, unsigned char *out) { //Encodes n counts into out, returns the number of bytes written
+	unsigned char *start = out;
+	int i = 0, j, valueBytes = lc_value_bytes(maxIter);
+	while(i < n) {
+		int run = 1;
+		while(i + run < n && run < LC_MAX_RUN && values[i + run] == values[i])
+			++run;
+		if(run > 1) { //Repeated value
+			*out++ = (unsigned char)(run + 126);
+			out = lc_put(out, values[i], valueBytes);
+			i += run;
+		}
+		else { //Literals up to the next pair of equal values
+			int literal = 1;
+			while(i + literal < n && literal < LC_MAX_LITERAL && (i + literal + 1 >= n || values[i + literal] != values[i + literal + 1]))
+				++literal;
+			*out++ = (unsigned char)(literal - 1);
+			for(j=0;j<literal;++j)
+				out = lc_put(out, values[i + j], valueBytes);
+			i += literal;
+		}
+	}
+	return (int)(out - start);
+}
+
+static inline int lc_decode(const unsigned char *in, int length, int maxIter, int *values, int n) { //Decodes straight into values, returns the number of counts written
+	const unsigned char *end = in + length;
+	int i = 0, j, valueBytes = lc_value_bytes(maxIter);
+	while(in < end && i < n) {
+		int header = *in++, value;
+		if(header < 128) {
+			for(j=0;j<=header && i<n;++j)
+				in = lc_get(in, &values[i++], valueBytes);
+		}
+		else {
+			in = lc_get(in, &value, valueBytes);
+			for(j=0;j<header - 126 && i<n;++j)
+				values[i++] = value;
+		}
+	}
+	return i;
+}
+
+#endif
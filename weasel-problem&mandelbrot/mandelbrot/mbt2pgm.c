@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tilefile.h"
+
+//Converts a tile file written with -o into a greyscale PGM, reading one row of tiles at a time.
+//Points inside the set are black, the rest are shaded by log(count). step > 1 keeps every step-th pixel.
+
+int main(int argc, char *argv[])
+{
+	FILE *in, *out;
+	tfheader header;
+	char raw[TF_HEADER_BYTES];
+	unsigned char *tileRow, *line;
+	size_t tileBytes;
+	int step = 1, outWidth, outHeight, tx, x, y;
+	double logMax;
+
+	if(argc < 3) {
+		fprintf(stderr, "Usage: %s tiles.mbt image.pgm [step]\n", argv[0]);
+		return 1;
+	}
+	if(argc > 3)
+		step = atoi(argv[3]);
+	if(step < 1)
+		step = 1;
+	if((in = fopen(argv[1], "rb")) == NULL || fread(raw, 1, TF_HEADER_BYTES, in) != TF_HEADER_BYTES) {
+		fprintf(stderr, "Cannot read %s\n", argv[1]);
+		return 1;
+	}
+	memcpy(&header, raw, sizeof(tfheader));
+	if(memcmp(header.magic, TF_MAGIC, 8) != 0) {
+		fprintf(stderr, "%s is not a tile file\n", argv[1]);
+		return 1;
+	}
+	if((out = fopen(argv[2], "wb")) == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[2]);
+		return 1;
+	}
+
+	tileBytes = (size_t)header.tileW * header.tileH * header.valueBytes;
+	tileRow = malloc(tileBytes * header.tilesX);
+	outWidth = (header.width + step - 1) / step;
+	outHeight = (header.height + step - 1) / step;
+	line = malloc(outWidth);
+	logMax = log(header.maxIter);
+	fprintf(out, "P5\n%d %d\n255\n", outWidth, outHeight);
+	printf("%d x %d, max %d iterations, centre %s %s, pixel %g\n", header.width, header.height, header.maxIter, header.centreRe, header.centreIm, header.pixelSize);
+
+	for(y=0;y<header.height;++y) {
+		int ty = y / header.tileH;
+		if(y % header.tileH == 0 && fread(tileRow, tileBytes, header.tilesX, in) != (size_t)header.tilesX) { //Next row of tiles, they are consecutive in the file
+			fprintf(stderr, "%s is truncated\n", argv[1]);
+			return 1;
+		}
+		if(y % step != 0)
+			continue;
+		for(x=0;x<header.width;x+=step) {
+			int count;
+			tx = x / header.tileW;
+			count = tf_unpack(tileRow + tx * tileBytes, &header, x - tx * header.tileW, y - ty * header.tileH);
+			line[x / step] = count >= header.maxIter ? 0 : (unsigned char)(32 + 223 * log(count) / logMax); //Leave black for the set itself
+		}
+		fwrite(line, 1, outWidth, out);
+	}
+	fclose(in);
+	fclose(out);
+	free(tileRow);
+	free(line);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdlib.h>
+
+#include "view.h"
+#include "deepzoom.h"
+#include "kernels.h"
+
+static inline void render_tile(const mandelview *view, const dzorbit *orbit, int x0, int y0, int w, int h, int *out) { //Computes a w by h block of counts, row by row
+	int x, y;
+	if(view->deep) { //Offsets from the reference orbit at the centre
+		for(y=0;y<h;++y) {
+			double dci = (view->height / 2 - (y0 + y)) * view->pixelSize;
+			for(x=0;x<w;++x)
+				out[y * w + x] = dz_pixel(orbit, (x0 + x - view->width / 2) * view->pixelSize, dci, view->maxIter);
+		}
+	}
+	else { //Row by row with the kernel chosen on the command line
+		kernelrow row = kernel_for(view)->row;
+		for(y=0;y<h;++y)
+			row(view, x0, y0 + y, w, out + y * w);
+	}
+}
+
+static inline void render_grid_tile(const mandelview *view, const dzorbit *orbit, long long gx, long long gy, int *out) { //Computes a cache tile whose top left is grid pixel gx,gy
+	int x, y, size = view->tileW;
+	double ps = view->pixelSize; //A power of two, so every sample lands exactly on the grid
+	if(view->deep) { //The grid is anchored at the reference
+		for(y=0;y<size;++y)
+			for(x=0;x<size;++x)
+				out[y * size + x] = dz_pixel(orbit, (gx + x) * ps, -(gy + y) * ps, view->maxIter);
+	}
+	else {
+		kernelrow row = kernel_for(view)->row;
+		for(y=0;y<size;++y)
+			row(view, gx, gy + y, size, out + y * size);
+	}
+}
+
+static inline int render_unit(const mandelview *view, const dzorbit *orbit, int unit, int *out) { //Computes one work unit, returns the number of counts written
+	int x0, y0, w, h;
+	if(view->cacheDir) {
+		render_grid_tile(view, orbit, (view->tileX0 + unit % view->tilesX) * view->tileW, (view->tileY0 + unit / view->tilesX) * view->tileH, out);
+		return view->tileW * view->tileH;
+	}
+	tile_rect(view, unit, &x0, &y0, &w, &h);
+	render_tile(view, orbit, x0, y0, w, h, out);
+	return w * h;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+/* Zoom animations rendered in one job.
+ * A keyframe file holds one "real imag zoom [maxiter]" line per keyframe ('#' starts a comment).
+ * Frames between keyframes zoom geometrically, and the centre moves in step with the visible span so a
+ * pan looks steady on screen. Every frame shares the base view's size and tiling, so work unit u is tile
+ * u % tiles of frame u / tiles. Deep frames perturb from a single reference orbit, so they need every
+ * keyframe to share one centre; the base view is widened to the finest pixel and highest iteration limit
+ * so that orbit serves every frame. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "view.h"
+
+#define SEQ_CENTRE_BYTES 256
+
+typedef struct {
+	char re[SEQ_CENTRE_BYTES], im[SEQ_CENTRE_BYTES];
+	double zoom;
+	int maxIter;
+} keyframe;
+
+typedef struct {
+	mandelview view; //The base view moved to this frame, its centre points at re and im
+	char re[SEQ_CENTRE_BYTES], im[SEQ_CENTRE_BYTES];
+} seqframe;
+
+static inline int seq_load(mandelview *base, seqframe **frames, int report) { //Builds every frame of the animation, returns the frame count or 0 on error, printing why if report is set
+	FILE *file;
+	char line[2 * SEQ_CENTRE_BYTES + 64];
+	keyframe *keys = NULL;
+	seqframe *out;
+	int count = 0, capacity = 0, shared = 1, total, i;
+
+	if((file = fopen(base->sequence, "r")) == NULL) {
+		if(report)
+			fprintf(stderr, "Cannot open keyframes %s\n", base->sequence);
+		return 0;
+	}
+	while(fgets(line, sizeof(line), file)) {
+		keyframe key;
+		int fields;
+		char *comment = strchr(line, '#');
+		if(comment)
+			*comment = '\0';
+		key.maxIter = base->maxIter;
+		fields = sscanf(line, "%255s %255s %lf %d", key.re, key.im, &key.zoom, &key.maxIter);
+		if(fields <= 0)
+			continue;
+		if(fields < 3 || key.zoom <= 0 || key.maxIter < 1) {
+			if(report)
+				fprintf(stderr, "Bad keyframe in %s: %s", base->sequence, line);
+			fclose(file);
+			free(keys);
+			return 0;
+		}
+		if(count == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			keys = realloc(keys, capacity * sizeof(keyframe));
+		}
+		keys[count++] = key;
+	}
+	fclose(file);
+	if(count == 0) {
+		if(report)
+			fprintf(stderr, "No keyframes in %s\n", base->sequence);
+		return 0;
+	}
+	for(i=1;i<count;++i)
+		if(strcmp(keys[i].re, keys[0].re) != 0 || strcmp(keys[i].im, keys[0].im) != 0)
+			shared = 0;
+
+	total = base->frames ? base->frames : count;
+	out = malloc(total * sizeof(seqframe));
+	for(i=0;i<total;++i) {
+		seqframe *frame = &out[i];
+		double t = total > 1 ? (double)i * (count - 1) / (total - 1) : 0, u, move;
+		int k = count > 1 && (int)t >= count - 1 ? count - 2 : (int)t;
+		const keyframe *a = &keys[k], *b = &keys[count > 1 ? k + 1 : k];
+		u = t - k;
+
+		frame->view = *base;
+		frame->view.zoom = a->zoom * pow(b->zoom / a->zoom, u);
+		frame->view.maxIter = (int)(a->maxIter + (b->maxIter - a->maxIter) * u + 0.5);
+		frame->view.pixelSize = DEFAULT_SPAN / (frame->view.zoom * base->width);
+		frame->view.deep = base->deep || (frame->view.pixelSize < min_pixel(base) && deep_capable(base));
+		if(shared) { //Keep every digit, the deep zoom engine needs them
+			strcpy(frame->re, a->re);
+			strcpy(frame->im, a->im);
+		}
+		else if(frame->view.deep) {
+			if(report)
+				fprintf(stderr, "Frame %d needs the deep zoom engine, which needs every keyframe to share one centre\n", i);
+			free(keys);
+			free(out);
+			return 0;
+		}
+		else { //Move with the span, so the centre covers equal screen distances per frame
+			move = a->zoom == b->zoom ? u : (1 / frame->view.zoom - 1 / a->zoom) / (1 / b->zoom - 1 / a->zoom);
+			snprintf(frame->re, SEQ_CENTRE_BYTES, "%.17g", atof(a->re) + (atof(b->re) - atof(a->re)) * move);
+			snprintf(frame->im, SEQ_CENTRE_BYTES, "%.17g", atof(a->im) + (atof(b->im) - atof(a->im)) * move);
+		}
+		frame->view.centreRe = frame->re;
+		frame->view.centreIm = frame->im;
+		frame->view.anchorRe = frame->re;
+		frame->view.anchorIm = frame->im;
+	}
+
+	for(i=0;i<total;++i) { //Widen the base view so one reference orbit covers every frame
+		if(i == 0 || out[i].view.pixelSize < base->pixelSize)
+			base->pixelSize = out[i].view.pixelSize;
+		if(i == 0 || out[i].view.maxIter > base->maxIter)
+			base->maxIter = out[i].view.maxIter;
+		base->deep |= out[i].view.deep;
+	}
+	base->centreRe = out[0].view.centreRe;
+	base->centreIm = out[0].view.centreIm;
+	base->anchorRe = base->centreRe;
+	base->anchorIm = base->centreIm;
+	base->frames = total;
+	free(keys);
+	*frames = out;
+	return total;
+}
+
+static inline int seq_write_pgm(const char *pattern, int frame, const int *counts, int width, int height, int maxIter) { //Writes a frame shaded like mbt2pgm, returns 0 on failure
+	char name[1024];
+	unsigned char *line = malloc(width);
+	double logMax = log(maxIter);
+	FILE *file;
+	int x, y;
+	snprintf(name, sizeof(name), pattern, frame);
+	if((file = fopen(name, "wb")) == NULL) {
+		fprintf(stderr, "Cannot open %s\n", name);
+		free(line);
+		return 0;
+	}
+	fprintf(file, "P5\n%d %d\n255\n", width, height);
+	for(y=0;y<height;++y) {
+		for(x=0;x<width;++x) {
+			int count = counts[(size_t)y * width + x];
+			line[x] = count >= maxIter ? 0 : (unsigned char)(32 + 223 * log(count) / logMax); //Leave black for the set itself
+		}
+		fwrite(line, 1, width, file);
+	}
+	fclose(file);
+	free(line);
+	return 1;
+}
+
+#endif
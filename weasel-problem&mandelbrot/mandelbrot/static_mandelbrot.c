@@ -1,187 +1,192 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 
 #include <X11/Xlib.h> //X11 library headers
 #include <X11/Xutil.h>
 #include <X11/Xos.h>
 
-#define X_RESN 1000 //X resolution
-#define Y_RESN 1000 //Y resolution
-#define REAL_MAX 2 //Real and imaginary ranges for the complex numbers
-#define REAL_MIN -2
-#define IMAG_MAX 2
-#define IMAG_MIN -2
+#include "view.h"
+#include "deepzoom.h"
+#include "linecodec.h"
+#include "render.h"
+#include "tilefile.h"
+#include "tilecache.h"
+#include "x11window.h"
 
-typedef struct { //Complex number struct
-	float real, imaginary;
-} complex;
-
-Display* x11setup(Window *win, GC *gc, int width, int height); //Function prototype
-
-int cal_pixel(complex c) {
-  int count, max;
-  complex z;
-  float temp, lengthsq;
-  max = 256; //Maximum number of iterations to do
-  z.real = 0; z.imaginary = 0; //Initialise value of complex struct
-  count = 0; //Current number of iterations
-  do {
-	temp = z.real * z.real - z.imaginary * z.imaginary + c.real;
-    z.imaginary = 2 * z.real * z.imaginary + c.imaginary;
-    z.real = temp;
-    lengthsq = z.real * z.real + z.imaginary * z.imaginary;
-    count++;
-  } while ((lengthsq < 4.0) && (count < max));
-  return count;
-}
 
 int main(int argc, char *argv[])
 {
-	int rank, worldSize, i, j, x, y;
+	int rank, worldSize, i;
+	unsigned int x, y; //Pixel, counted up to the unsigned window size
 	double time;
-	unsigned int width = X_RESN, height = Y_RESN; //Window size
-	Window win; //Initialization for a window
-	GC gc; //Graphics context
+	unsigned int width, height; //Window size
+	Window win = 0; //Initialization for a window
+	GC gc = NULL; //Graphics context
 	Display *display = NULL;
+	mandelview view; //Region, size, iteration limit and output from the command line
+	dzorbit orbit = {0}; //Deep zoom reference orbit
+	int unit, x0, y0, w, h, packetSize, packetBytes;
+	unsigned char *packet; //Unit number followed by the encoded unit
+	int *tile; //Counts for one work unit
+	int *missing, missingCount; //Units the cache could not supply, the workers only compute these
 	
 	MPI_Init(&argc, &argv); 
 	MPI_Comm_size(MPI_COMM_WORLD, &worldSize); 
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	
+	if(!parse_view(argc, argv, &view) || view.sequence) {
+		if(rank==0 && view.sequence)
+			fprintf(stderr, "Animations are rendered by the dynamic driver\n");
+		else if(rank==0)
+			view_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+	width = view.width;
+	height = view.height;
+	packetBytes = sizeof(int) + LC_MAX_BYTES(view.tileW * view.tileH);
+	packet = malloc(packetBytes);
+	tile = malloc((size_t)view.tileW * view.tileH * sizeof(int));
+	missing = malloc(view.tiles * sizeof(int));
+	missingCount = view.tiles;
+	for(i=0;i<view.tiles;++i)
+		missing[i] = i;
+	if(view.deep) { //The master computes the reference orbit once and every worker perturbs from it
+		if(rank==0) {
+			dz_reference_orbit(view.anchorRe, view.anchorIm, view.pixelSize, view.maxIter, &orbit);
+			if(orbit.escaped)
+				printf("Warning: reference escaped after %d iterations, pick a centre closer to the set\n", orbit.length - 1);
+		}
+		dz_bcast_orbit(&orbit, 0, MPI_COMM_WORLD);
+	}
         
 	if(rank==0) //Master node operations
 	{
-		int mandelbrot[Y_RESN][X_RESN] = {0}; //2D array to store the mandelbrot pixel values into
-		int imageLine, running = 1;
+		int *mandelbrot = NULL; //Whole image of pixel values, only kept when drawing to a window
+		int running = 1;
+		long wireBytes = 0, rawBytes = 0; //Bytes received against what the old int per pixel format would send
+		tilewriter writer;
+		tilecache cache;
+		double *lastArrival = NULL, cacheTime = 0, computeSeconds = 0; //When each worker last delivered, to time its tiles
 		MPI_Status stat;
 		
-		display = x11setup(&win, &gc, width, height);
+		if(view.output) { //Stream tiles to disk, memory stays bounded by the reorder window
+			if(!tw_open(&writer, &view))
+				MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		else {
+			mandelbrot = calloc((size_t)width * height, sizeof(int));
+			display = x11setup(&win, &gc, width, height);
+		}
 		time = MPI_Wtime(); //Get the start time
+		if(view.cacheDir) { //Fill in what earlier runs left behind, then tell the workers what is still missing
+			tc_init(&cache, &view);
+			missingCount = 0;
+			for(i=0;i<view.tiles;++i) {
+				if(tc_lookup(&cache, i, tile))
+					tc_blit(&view, i, tile, mandelbrot);
+				else
+					missing[missingCount++] = i;
+			}
+			cacheTime = MPI_Wtime() - time;
+			lastArrival = malloc(worldSize * sizeof(double));
+			for(i=0;i<worldSize;++i)
+				lastArrival[i] = MPI_Wtime();
+			MPI_Bcast(&missingCount, 1, MPI_INT, 0, MPI_COMM_WORLD);
+			MPI_Bcast(missing, missingCount, MPI_INT, 0, MPI_COMM_WORLD);
+		}
 		
-		for(i=0;i<Y_RESN;++i) { //Recv for the number of times there are lines in the Y resolution
-			MPI_Recv(&imageLine, 1, MPI_INT, MPI_ANY_SOURCE, 1, MPI_COMM_WORLD, &stat); //Receive which line will be added
-			MPI_Recv(&(mandelbrot[imageLine]), X_RESN, MPI_INT, stat.MPI_SOURCE, 2, MPI_COMM_WORLD, &stat); //Receive mandelbrot line
+		for(i=0;i<missingCount;++i) { //Recv once for every work unit that has to be computed
+			MPI_Recv(packet, packetBytes, MPI_BYTE, MPI_ANY_SOURCE, 1, MPI_COMM_WORLD, &stat); //Receive an encoded unit
+			MPI_Get_count(&stat, MPI_BYTE, &packetSize);
+			memcpy(&unit, packet, sizeof(int)); //Which unit will be added
+			tile_rect(&view, unit, &x0, &y0, &w, &h);
+			if(view.cacheDir) { //Units are grid tiles, keep them for later runs and clip them into the image
+				double now = MPI_Wtime(), seconds = now - lastArrival[stat.MPI_SOURCE]; //Workers compute back to back, so the gap is the tile's cost
+				lastArrival[stat.MPI_SOURCE] = now;
+				computeSeconds += seconds;
+				w = view.tileW;
+				h = view.tileH;
+				lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, tile, w * h);
+				tc_store(&cache, unit, tile, seconds);
+				tc_blit(&view, unit, tile, mandelbrot);
+			}
+			else if(view.output) {
+				lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, tile, w * h);
+				tw_put(&writer, unit, tile, w, h);
+			}
+			else //Units are whole lines, decode straight into the image
+				lc_decode(packet + sizeof(int), packetSize - sizeof(int), view.maxIter, mandelbrot + (size_t)y0 * width, w * h);
+			wireBytes += packetSize;
+			rawBytes += (w * h + 1) * sizeof(int);
 		}
 		
 		time = MPI_Wtime() - time; //Get time taken to calculate the mandelbrot
 		printf("Calculation time took %f seconds\n", time); //Print elapsed time
+		printf("Bytes on wire: %ld (%ld as raw ints, %.1fx smaller)\n", wireBytes, rawBytes, wireBytes ? (double)rawBytes / wireBytes : 0);
 		
-		XClearWindow(display, win); //Clear window and draw the Mandelbrot
-		for(i=0;i<X_RESN;++i) {
-			for(j=0;j<Y_RESN;++j) {
-				if(mandelbrot[i][j]==256)
-					XDrawPoint(display, win, gc, j, i); //Draw point at i,j in white
-			//Use XDrawPoint(display, win, gc, x, y) to draw a single pixel at (x,y)
-			XFlush(display);
-			}
+		if(view.cacheDir) {
+			int evicted = tc_evict(&cache);
+			printf("Cache: %d hits, %d derived from level %d, %d computed (%.1f%% hit rate) in %f seconds of lookups\n", cache.hits, cache.derived, view.level + 1, missingCount, 100.0 * (view.tiles - missingCount) / view.tiles, cacheTime);
+			printf("Cache saved about %f seconds of worker time (%f seconds of wall time), %d old tiles evicted\n", cache.secondsSaved, cache.secondsSaved / (worldSize - 1), evicted);
+			if(missingCount)
+				printf("Computed tiles averaged %f seconds\n", computeSeconds / missingCount);
+			tc_free(&cache);
+			free(lastArrival);
 		}
+		if(view.output) {
+			tw_close(&writer);
+			printf("Wrote %ld bytes of tiles to %s in %d writes, at most %d tiles buffered\n", writer.bytes, view.output, writer.writes, writer.peakBuffered);
+		}
+		else {
+			XClearWindow(display, win); //Clear window and draw the Mandelbrot
+			for(y=0;y<height;++y) {
+				for(x=0;x<width;++x) {
+					if(mandelbrot[(size_t)y * width + x]==view.maxIter)
+						XDrawPoint(display, win, gc, x, y); //Draw point at x,y in white
+				//Use XDrawPoint(display, win, gc, x, y) to draw a single pixel at (x,y)
+				XFlush(display);
+				}
+			}
 
-		while(running) { //Wait for user to exit screen with keypress
-			if(XPending(display)) {
-				XEvent ev;
-				XNextEvent(display, &ev);
-				switch(ev.type) {
-					case KeyPress:
-						running = 0;
-						break;
+			while(running) { //Wait for user to exit screen with keypress
+				if(XPending(display)) {
+					XEvent ev;
+					XNextEvent(display, &ev);
+					switch(ev.type) {
+						case KeyPress:
+							running = 0;
+							break;
+					}
 				}
 			}
+			XCloseDisplay(display); //Close the display window
+			free(mandelbrot);
 		}
-		XCloseDisplay(display); //Close the display window
 	} //End master node operations
 	
 	else { //Slave node operations
-		complex c;
-		int line = rank - 1, nodes = worldSize - 1;
-		float realStep = (float)(REAL_MAX - REAL_MIN) / X_RESN, imagStep = (float)(IMAG_MAX - IMAG_MIN) / Y_RESN; //Real and imaginary interpolation values
-		int mandelbrotLine[X_RESN] = {0}; //1D array to store line value into
+		int nodes = worldSize - 1, n;
 		
-		while(line <= Y_RESN) {
-			c.real = -2; //Set real and imaginary parts of the complex number to start with
-			c.imaginary = 2 - (line * imagStep);
-			for(i=0;i<X_RESN;++i) { //Calculate every pixel in the line
-				mandelbrotLine[i] = cal_pixel(c);
-				c.real += realStep; //Increment the real value of the complex number
-			}
-			MPI_Send(&line, 1, MPI_INT, 0, 1, MPI_COMM_WORLD);
-			MPI_Send(&mandelbrotLine, X_RESN, MPI_INT, 0, 2, MPI_COMM_WORLD);
-			line += nodes; //Go to the next line
+		if(view.cacheDir) { //Only the units the master's cache lookup missed
+			MPI_Bcast(&missingCount, 1, MPI_INT, 0, MPI_COMM_WORLD);
+			MPI_Bcast(missing, missingCount, MPI_INT, 0, MPI_COMM_WORLD);
+		}
+		for(i=rank-1;i<missingCount;i+=nodes) { //Every nodes-th unit starting from this rank's
+			unit = missing[i];
+			n = render_unit(&view, &orbit, unit, tile);
+			memcpy(packet, &unit, sizeof(int)); //Send the unit number and encoded unit as one message
+			packetSize = sizeof(int) + lc_encode(tile, n, view.maxIter, packet + sizeof(int));
+			MPI_Send(packet, packetSize, MPI_BYTE, 0, 1, MPI_COMM_WORLD);
 		}
 		
 	} //End slave node operations
 	
+	free(packet);
+	free(tile);
+	free(missing);
 	MPI_Finalize();
 	return 0;
-}
-
-
-Display * x11setup(Window *win, GC *gc, int width, int height)
-{
-	
-	/* --------------------------- X11 graphics setup ------------------------------ */
-	Display 		*display;
-	unsigned int 	win_x,win_y, /* window position */
-					border_width, /* border width in pixels */
-					display_width, display_height, /* size of screen */
-					screen; /* which screen */
-	
-	char 			window_name[] = "Mandelbrot", *display_name = NULL;
-	unsigned long 	valuemask = 0;
-	XGCValues 		values;
-	
-	XSizeHints 		size_hints;
-	
-	//Pixmap 		bitmap;
-	//XPoint 		points[800];
-	FILE 			*fopen ();//, *fp;
-	//char 			str[100];
-	
-	XSetWindowAttributes attr[1];
-	
-	if ( (display = XOpenDisplay (display_name)) == NULL ) { /* connect to Xserver */
-		fprintf (stderr, "Cannot connect to X server %s\n",XDisplayName (display_name) );
-		exit (-1);
-	}
-	
-	screen = DefaultScreen (display); /* get screen size */
-	display_width = DisplayWidth (display, screen);
-	display_height = DisplayHeight (display, screen);
-	
-	win_x = 0; win_y = 0; /* set window position */
-	
-	border_width = 4; /* create opaque window */
-	*win = XCreateSimpleWindow (display, RootWindow (display, screen),
-			win_x, win_y, width, height, border_width,
-			WhitePixel (display, screen), BlackPixel (display, screen));
-			
-	size_hints.flags = USPosition|USSize;
-	size_hints.x = win_x;
-	size_hints.y = win_y;
-	size_hints.width = width;
-	size_hints.height = height;
-	size_hints.min_width = 300;
-	size_hints.min_height = 300;
-	
-	XSetNormalHints (display, *win, &size_hints);
-	XStoreName(display, *win, window_name);
-	
-	*gc = XCreateGC (display, *win, valuemask, &values); /* create graphics context */
-	
-	XSetBackground (display, *gc, BlackPixel (display, screen));
-	XSetForeground (display, *gc, WhitePixel (display, screen));
-	XSetLineAttributes (display, *gc, 1, LineSolid, CapRound, JoinRound);
-	
-	attr[0].backing_store = Always;
-	attr[0].backing_planes = 1;
-	attr[0].backing_pixel = BlackPixel(display, screen);
-	
-	XChangeWindowAttributes(display, *win, CWBackingStore | CWBackingPlanes | CWBackingPixel, attr);
-	
-	XSelectInput(display, *win, KeyPressMask);
-	
-	XMapWindow (display, *win);
-	XSync(display, 0);
-	
-	/* --------------------------- End of X11 graphics setup ------------------------------ */
-	return display;
 }
\ No newline at end of file
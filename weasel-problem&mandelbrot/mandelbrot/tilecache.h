@@ -0,0 +1,219 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+/* Persistent tile cache for renders to a window.
+ * Cached views use a pixel size of DEFAULT_SPAN / 2^level on a grid anchored at the origin, or for deep
+ * zooms at the centre cut to a decimal place DEEP_ANCHOR_PIXELS or more wide, which is also the reference.
+ * Panning by whole pixels, within that decimal place for deep zooms, hits tiles from earlier runs. Every entry is a
+ * file named by the FNV-1a hash of its key (anchor, level, tile, maxIter, kernel, tile size) holding the
+ * key and the tile's counts in the wire format. Grid pixel 2x at level+1 samples the same point as pixel
+ * x at level, so a missing tile is also rebuilt exactly from its four children when zooming out.
+ * File modification times order the entries for least recently used eviction. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "view.h"
+#include "linecodec.h"
+#include "kernels.h"
+
+#define TC_MAGIC "MBCACHE1"
+#define TC_KEY_BYTES 512
+
+typedef struct {
+	const mandelview *view;
+	char kernel[96]; //Which pixel kernel filled the tile, results differ between them
+	int *scratch; //One child tile when deriving from the next level
+	unsigned char *encoded;
+	int hits, derived, misses;
+	double secondsSaved; //Worker time recorded for the tiles that were reused
+} tilecache;
+
+typedef struct { //Cost of a tile stored after the key
+	int encodedBytes;
+	double seconds;
+} tcentry;
+
+static inline void tc_init(tilecache *tc, const mandelview *view) {
+	memset(tc, 0, sizeof(tilecache));
+	tc->view = view;
+	if(view->deep)
+		strcpy(tc->kernel, "perturb-double");
+	else if(view->julia)
+		snprintf(tc->kernel, sizeof(tc->kernel), "%s(%.17g,%.17g)", kernel_for(view)->name, view->juliaRe, view->juliaIm);
+	else
+		strcpy(tc->kernel, kernel_for(view)->name);
+	tc->scratch = malloc((size_t)view->tileW * view->tileH * sizeof(int));
+	tc->encoded = malloc(LC_MAX_BYTES(view->tileW * view->tileH));
+	mkdir(view->cacheDir, 0755);
+}
+
+static inline void tc_path(const tilecache *tc, int level, long long tx, long long ty, char *key, char *path, size_t pathBytes) { //Key for a tile and the file it lives in
+	const mandelview *view = tc->view;
+	uint64_t hash = 1469598103934665603ULL;
+	const char *p;
+	snprintf(key, TC_KEY_BYTES, "%s|%s|%d|%lld|%lld|%d|%s|%d", view->anchorRe, view->anchorIm, level, tx, ty, view->maxIter, tc->kernel, view->tileW);
+	for(p=key;*p;++p) //FNV-1a
+		hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+	snprintf(path, pathBytes, "%s/%016llx.tile", view->cacheDir, (unsigned long long)hash);
+}
+
+static inline int tc_read(tilecache *tc, int level, long long tx, long long ty, int *out, double *seconds) { //Loads one tile, returns 0 if it is not cached
+	char key[TC_KEY_BYTES], stored[TC_KEY_BYTES], path[1024], magic[8];
+	int keyBytes, size = tc->view->tileW * tc->view->tileH;
+	tcentry entry;
+	FILE *file;
+	tc_path(tc, level, tx, ty, key, path, sizeof(path));
+	if((file = fopen(path, "rb")) == NULL)
+		return 0;
+	if(fread(magic, 1, 8, file) != 8 || memcmp(magic, TC_MAGIC, 8) != 0
+			|| fread(&keyBytes, sizeof(int), 1, file) != 1 || keyBytes <= 0 || keyBytes >= TC_KEY_BYTES
+			|| fread(stored, 1, keyBytes, file) != (size_t)keyBytes
+			|| fread(&entry, sizeof(tcentry), 1, file) != 1 || entry.encodedBytes > LC_MAX_BYTES(size)
+			|| fread(tc->encoded, 1, entry.encodedBytes, file) != (size_t)entry.encodedBytes) {
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+	stored[keyBytes] = '\0';
+	if(strcmp(stored, key) != 0) //Hash collision
+		return 0;
+	if(lc_decode(tc->encoded, entry.encodedBytes, tc->view->maxIter, out, size) != size)
+		return 0;
+	utime(path, NULL); //Mark as recently used
+	*seconds = entry.seconds;
+	return 1;
+}
+
+static inline int tc_lookup(tilecache *tc, int unit, int *out) { //Fills in a unit from the cache, returns 0 on a miss
+	const mandelview *view = tc->view;
+	long long tx = view->tileX0 + unit % view->tilesX, ty = view->tileY0 + unit / view->tilesX;
+	int size = view->tileW, half = size / 2, a, b, x, y;
+	double seconds, childSeconds = 0;
+
+	if(tc_read(tc, view->level, tx, ty, out, &seconds)) {
+		++tc->hits;
+		tc->secondsSaved += seconds;
+		return 1;
+	}
+	if(size % 2 == 0) { //Zooming out, every other pixel of the four tiles one level in
+		for(b=0;b<2;++b)
+			for(a=0;a<2;++a) {
+				if(!tc_read(tc, view->level + 1, 2 * tx + a, 2 * ty + b, tc->scratch, &seconds)) {
+					++tc->misses;
+					return 0;
+				}
+				childSeconds += seconds;
+				for(y=0;y<half;++y)
+					for(x=0;x<half;++x)
+						out[(b * half + y) * size + a * half + x] = tc->scratch[2 * y * size + 2 * x];
+			}
+		++tc->derived;
+		tc->secondsSaved += childSeconds / 4;
+		return 1;
+	}
+	++tc->misses;
+	return 0;
+}
+
+static inline void tc_store(tilecache *tc, int unit, const int *values, double seconds) { //Adds a freshly computed unit to the cache
+	const mandelview *view = tc->view;
+	char key[TC_KEY_BYTES], path[1024];
+	int keyBytes;
+	tcentry entry;
+	FILE *file;
+	tc_path(tc, view->level, view->tileX0 + unit % view->tilesX, view->tileY0 + unit / view->tilesX, key, path, sizeof(path));
+	if((file = fopen(path, "wb")) == NULL)
+		return;
+	keyBytes = strlen(key);
+	entry.encodedBytes = lc_encode(values, view->tileW * view->tileH, view->maxIter, tc->encoded);
+	entry.seconds = seconds;
+	fwrite(TC_MAGIC, 1, 8, file);
+	fwrite(&keyBytes, sizeof(int), 1, file);
+	fwrite(key, 1, keyBytes, file);
+	fwrite(&entry, sizeof(tcentry), 1, file);
+	fwrite(tc->encoded, 1, entry.encodedBytes, file);
+	fclose(file);
+}
+
+typedef struct {
+	char name[32];
+	time_t used;
+	off_t bytes;
+} tcfile;
+
+static inline int tc_compare_used(const void *a, const void *b) { //Oldest first
+	const tcfile *fa = a, *fb = b;
+	return (fa->used > fb->used) - (fa->used < fb->used);
+}
+
+static inline int tc_evict(tilecache *tc) { //Deletes least recently used tiles until the cache fits, returns how many went
+	DIR *dir;
+	struct dirent *ent;
+	struct stat info;
+	tcfile *files = NULL;
+	int count = 0, capacity = 0, i, evicted = 0;
+	long long total = 0;
+	char path[1024];
+
+	if((dir = opendir(tc->view->cacheDir)) == NULL)
+		return 0;
+	while((ent = readdir(dir)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		if(len < 5 || len >= sizeof(files->name) || strcmp(ent->d_name + len - 5, ".tile") != 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", tc->view->cacheDir, ent->d_name);
+		if(stat(path, &info) != 0)
+			continue;
+		if(count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			files = realloc(files, capacity * sizeof(tcfile));
+		}
+		strcpy(files[count].name, ent->d_name);
+		files[count].used = info.st_mtime;
+		files[count].bytes = info.st_size;
+		total += info.st_size;
+		++count;
+	}
+	closedir(dir);
+
+	if(total > tc->view->cacheBytes) {
+		qsort(files, count, sizeof(tcfile), tc_compare_used);
+		for(i=0;i<count && total>tc->view->cacheBytes;++i) {
+			snprintf(path, sizeof(path), "%s/%s", tc->view->cacheDir, files[i].name);
+			if(unlink(path) == 0) {
+				total -= files[i].bytes;
+				++evicted;
+			}
+		}
+	}
+	free(files);
+	return evicted;
+}
+
+static inline void tc_blit(const mandelview *view, int unit, const int *tile, int *image) { //Copies the part of a cache tile inside the view into the image
+	long long gx = (view->tileX0 + unit % view->tilesX) * view->tileW - view->gridX0;
+	long long gy = (view->tileY0 + unit / view->tilesX) * view->tileH - view->gridY0;
+	int x, y;
+	for(y=0;y<view->tileH;++y) {
+		if(gy + y < 0 || gy + y >= view->height)
+			continue;
+		for(x=0;x<view->tileW;++x)
+			if(gx + x >= 0 && gx + x < view->width)
+				image[(gy + y) * view->width + gx + x] = tile[y * view->tileW + x];
+	}
+}
+
+static inline void tc_free(tilecache *tc) {
+	free(tc->scratch);
+	free(tc->encoded);
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef TILEFILE_H
+#define TILEFILE_H
+
+/* Tile file holding a rendered image of any size.
+ * A fixed TF_HEADER_BYTES header is followed by tilesX * tilesY tiles in row-major tile order.
+ * Every tile is tileW * tileH values stored row by row as count - 1 in valueBytes little endian bytes,
+ * edge tiles are padded to full size, so tile t always starts at TF_HEADER_BYTES + t * tileBytes.
+ * The writer (only compiled when mpi.h is included) keeps a bounded ring of completed tiles and writes
+ * runs of consecutive tiles with one MPI_File_write_at, tiles too far ahead of the ring go straight out. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "view.h"
+#include "linecodec.h"
+
+#define TF_MAGIC "MBTILES1"
+#define TF_HEADER_BYTES 256
+
+typedef struct { //On-disk header, padded out to TF_HEADER_BYTES
+	char magic[8];
+	int32_t width, height, tileW, tileH, tilesX, tilesY, maxIter, valueBytes;
+	double pixelSize;
+	char centreRe[96], centreIm[96]; //Centre of the view, truncated if longer
+} tfheader;
+
+static inline void tf_pack(const int *values, int w, int h, const tfheader *header, unsigned char *tile) { //Packs a w by h block into a padded tile
+	int x, y, b;
+	memset(tile, 0, (size_t)header->tileW * header->tileH * header->valueBytes);
+	for(y=0;y<h;++y)
+		for(x=0;x<w;++x) {
+			unsigned int v = values[y * w + x] - 1;
+			unsigned char *dest = tile + ((size_t)y * header->tileW + x) * header->valueBytes;
+			for(b=0;b<header->valueBytes;++b)
+				dest[b] = (v >> (8 * b)) & 0xff;
+		}
+}
+
+static inline int tf_unpack(const unsigned char *tile, const tfheader *header, int x, int y) { //Count at x,y inside a tile
+	const unsigned char *src = tile + ((size_t)y * header->tileW + x) * header->valueBytes;
+	unsigned int v = 0;
+	int b;
+	for(b=0;b<header->valueBytes;++b)
+		v |= (unsigned int)src[b] << (8 * b);
+	return (int)v + 1;
+}
+
+#ifdef MPI_VERSION
+
+typedef struct {
+	MPI_File file;
+	tfheader header;
+	size_t tileBytes;
+	int window; //Tiles the ring can hold
+	int nextTile; //Lowest tile not yet on disk
+	int *ringTile; //Tile held in each ring slot, -1 when empty
+	unsigned char *ring, *scratch;
+	unsigned char *written; //One bit per tile written ahead of nextTile
+	int buffered, peakBuffered, writes;
+	long bytes;
+} tilewriter;
+
+static inline int tw_open(tilewriter *tw, const mandelview *view) { //Creates the file and writes its header, returns 0 on failure
+	char header[TF_HEADER_BYTES] = {0};
+	int i;
+	memset(tw, 0, sizeof(tilewriter));
+	memcpy(tw->header.magic, TF_MAGIC, 8);
+	tw->header.width = view->width;
+	tw->header.height = view->height;
+	tw->header.tileW = view->tileW;
+	tw->header.tileH = view->tileH;
+	tw->header.tilesX = view->tilesX;
+	tw->header.tilesY = view->tilesY;
+	tw->header.maxIter = view->maxIter;
+	tw->header.valueBytes = lc_value_bytes(view->maxIter); //Same widths as the wire format
+	tw->header.pixelSize = view->pixelSize;
+	strncpy(tw->header.centreRe, view->centreRe, sizeof(tw->header.centreRe) - 1);
+	strncpy(tw->header.centreIm, view->centreIm, sizeof(tw->header.centreIm) - 1);
+
+	if(MPI_File_open(MPI_COMM_SELF, (char *)view->output, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &tw->file) != MPI_SUCCESS) {
+		fprintf(stderr, "Cannot open %s for writing\n", view->output);
+		return 0;
+	}
+	MPI_File_set_size(tw->file, 0);
+	memcpy(header, &tw->header, sizeof(tfheader));
+	MPI_File_write_at(tw->file, 0, header, TF_HEADER_BYTES, MPI_BYTE, MPI_STATUS_IGNORE);
+
+	tw->tileBytes = (size_t)view->tileW * view->tileH * tw->header.valueBytes;
+	tw->window = view->window;
+	tw->ring = malloc(tw->window * tw->tileBytes);
+	tw->scratch = malloc(tw->tileBytes);
+	tw->ringTile = malloc(tw->window * sizeof(int));
+	tw->written = calloc(view->tiles / 8 + 1, 1);
+	for(i=0;i<tw->window;++i)
+		tw->ringTile[i] = -1;
+	return 1;
+}
+
+static inline void tw_write(tilewriter *tw, int tile, const unsigned char *data, int count) { //Writes count consecutive tiles starting at tile
+	MPI_Offset offset = TF_HEADER_BYTES + (MPI_Offset)tile * tw->tileBytes;
+	MPI_File_write_at(tw->file, offset, (void *)data, (int)(count * tw->tileBytes), MPI_BYTE, MPI_STATUS_IGNORE);
+	tw->bytes += count * tw->tileBytes;
+	++tw->writes;
+}
+
+static inline void tw_flush(tilewriter *tw) { //Writes every run of tiles that continues from nextTile
+	int tiles = tw->header.tilesX * tw->header.tilesY;
+	while(tw->nextTile < tiles) {
+		int slot = tw->nextTile % tw->window, run = 0;
+		if(tw->written[tw->nextTile >> 3] & (1 << (tw->nextTile & 7))) { //Already went out ahead of the ring
+			++tw->nextTile;
+			continue;
+		}
+		while(slot + run < tw->window && tw->ringTile[slot + run] == tw->nextTile + run) { //Run of consecutive tiles, stopping at the end of the ring
+			tw->ringTile[slot + run] = -1;
+			++run;
+		}
+		if(run == 0)
+			break;
+		tw_write(tw, tw->nextTile, tw->ring + slot * tw->tileBytes, run);
+		tw->nextTile += run;
+		tw->buffered -= run;
+	}
+}
+
+static inline void tw_put(tilewriter *tw, int tile, const int *values, int w, int h) { //Hands a finished tile to the writer
+	if(tile < tw->nextTile + tw->window) { //Fits in the ring, hold it until the tiles before it arrive
+		int slot = tile % tw->window;
+		tf_pack(values, w, h, &tw->header, tw->ring + slot * tw->tileBytes);
+		tw->ringTile[slot] = tile;
+		if(++tw->buffered > tw->peakBuffered)
+			tw->peakBuffered = tw->buffered;
+		tw_flush(tw);
+	}
+	else { //Too far ahead to buffer, write it on its own
+		tf_pack(values, w, h, &tw->header, tw->scratch);
+		tw_write(tw, tile, tw->scratch, 1);
+		tw->written[tile >> 3] |= 1 << (tile & 7);
+	}
+}
+
+static inline void tw_close(tilewriter *tw) {
+	tw_flush(tw);
+	MPI_File_close(&tw->file);
+	free(tw->ring);
+	free(tw->scratch);
+	free(tw->ringTile);
+	free(tw->written);
+}
+
+#endif
+
+#endif
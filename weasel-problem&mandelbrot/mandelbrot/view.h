@@ -0,0 +1,299 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_RESN 1000 //Image width and height used when -s is not given
+#define DEFAULT_MAX_ITER 256 //Iteration limit used when -i is not given
+#define DEFAULT_DEPTH 2 //Outstanding work units per worker, 2 keeps the next unit queued while one is computed
+#define DEFAULT_TILE 256 //Tile edge in pixels when streaming to a file
+#define DEFAULT_WINDOW 64 //Completed tiles the master may hold while waiting for earlier ones
+#define DEFAULT_CACHE_MB 256 //Tile cache size limit on disk
+#define DEFAULT_IN_FLIGHT 4 //Animation frames the master holds images for at once
+#define DEFAULT_FRAME_NAME "frame%05d.pgm" //Output pattern for animation frames
+#define DEFAULT_SPAN 4.0 //Width of the complex plane shown at zoom 1, i.e. -2..2
+#define FLOAT_MIN_PIXEL 1e-6 //Below this pixel size float coordinates turn into blocks, switch to the deep zoom engine
+#define DOUBLE_MIN_PIXEL 1e-14 //Same for double kernels
+#define LONG_MIN_PIXEL 1e-17 //Same for long double kernels, where long double is wider than double
+#define MAX_POWER 5 //Highest power of z with a compiled kernel
+#define DEEP_ANCHOR_PIXELS 1024 //Cached deep views snap their anchor to the last decimal place at least this many pixels wide
+#define ANCHOR_BYTES 512 //Longest anchor kept, enough digits for any zoom the deep zoom engine reaches
+
+#define PRECISION_FLOAT 0 //Scalar types the escape-time kernels are compiled for
+#define PRECISION_DOUBLE 1
+#define PRECISION_LONG 2
+
+typedef struct { //Region of the complex plane being rendered and how the work is cut up
+	const char *centreRe, *centreIm; //Centre as decimal strings so the deep zoom engine can use every digit
+	char regionCentre[2][32]; //Storage for the centre when it is derived from -region
+	double zoom; //Magnification relative to the default -2..2 view
+	double pixelSize; //Width of one pixel in the complex plane
+	int width, height; //Image size in pixels
+	int maxIter; //Maximum number of iterations per pixel
+	int deep; //Non-zero when pixels are computed by perturbation from a reference orbit
+	int depth; //Work units the dynamic scheduler keeps outstanding per worker
+	const char *output; //Tile file to stream into, NULL to draw in an X11 window
+	int window; //Reorder buffer size in tiles when streaming
+	int tileW, tileH, tilesX, tilesY, tiles; //Work unit size and count, whole lines unless streaming or caching
+	const char *cacheDir; //Tile cache directory, NULL when not caching
+	long cacheBytes; //Size the cache is trimmed back to
+	const char *anchorRe, *anchorIm; //Point the cache's tile grid and the deep zoom reference orbit are measured from
+	char anchorDigits[2][ANCHOR_BYTES]; //Storage for a deep anchor cut from the centre
+	int level; //Cached views have a pixel size of DEFAULT_SPAN / 2^level
+	long long gridX0, gridY0; //Grid pixel at the top left of the view
+	long long tileX0, tileY0; //Grid tile of unit 0
+	const char *sequence; //Keyframe file for an animation, NULL for a single image
+	int frames; //Frames to interpolate along the keyframes, 0 for one per keyframe
+	int inFlight; //Frames that may be rendered at the same time
+	int threads; //Compute threads per rank in the hybrid driver, 0 to share the node's cores between its ranks
+	int julia; //Non-zero to draw the Julia set of juliaRe + juliaIm i instead of the Mandelbrot set
+	double juliaRe, juliaIm;
+	int power; //Iterates z^power + c
+	int precision; //Scalar type of the kernel, one of the PRECISION_ values
+} mandelview;
+
+static inline void view_usage(const char *prog) {
+	fprintf(stderr, "Usage: %s [-s width height] [-c real imag] [-z zoom] [-region xmin xmax ymin ymax] [-i maxiter] [-deep] [-k depth] [-o file [-t tile] [-w window] | -cache dir [-cachemb size] | -seq keyframes [-frames n] [-f frames] [-o pattern] [-t tile]] [-threads n] [-julia real imag] [-power d] [-precision float|double|long]\n", prog);
+	fprintf(stderr, "  -s width height  image size in pixels (default %d x %d)\n", DEFAULT_RESN, DEFAULT_RESN);
+	fprintf(stderr, "  -c real imag     centre of the view (decimal strings, any number of digits)\n");
+	fprintf(stderr, "  -z zoom          magnification, 1 shows -2..2 (e.g. 1e100)\n");
+	fprintf(stderr, "  -region xmin xmax ymin ymax  view given by its corners instead of -c and -z, the height follows the width\n");
+	fprintf(stderr, "  -i maxiter       maximum iterations per pixel (default %d)\n", DEFAULT_MAX_ITER);
+	fprintf(stderr, "  -deep            force the perturbation engine even at shallow zooms\n");
+	fprintf(stderr, "  -k depth         work units kept outstanding per worker by the dynamic scheduler (default %d)\n", DEFAULT_DEPTH);
+	fprintf(stderr, "  -o file          stream tiles into a tile file instead of opening a window\n");
+	fprintf(stderr, "  -t tile          tile edge in pixels when streaming (default %d)\n", DEFAULT_TILE);
+	fprintf(stderr, "  -w window        tiles the master buffers to write them in order (default %d)\n", DEFAULT_WINDOW);
+	fprintf(stderr, "  -cache dir       reuse tiles from earlier runs kept in dir, the zoom snaps to a power of two\n");
+	fprintf(stderr, "  -cachemb size    megabytes the cache is trimmed back to, least recently used first (default %d)\n", DEFAULT_CACHE_MB);
+	fprintf(stderr, "  -seq keyframes   render an animation, one \"real imag zoom [maxiter]\" keyframe per line (dynamic driver only)\n");
+	fprintf(stderr, "  -frames n        frames interpolated along the keyframes (default one per keyframe)\n");
+	fprintf(stderr, "  -f frames        frames rendered at the same time so no rank waits between frames (default %d)\n", DEFAULT_IN_FLIGHT);
+	fprintf(stderr, "                   animation frames are written to the -o pattern, with one %%d for the frame number (default %s)\n", DEFAULT_FRAME_NAME);
+	fprintf(stderr, "  -threads n       compute threads per rank in the hybrid driver (default the node's cores shared between its ranks)\n");
+	fprintf(stderr, "  -julia real imag draw the Julia set of this point instead of the Mandelbrot set\n");
+	fprintf(stderr, "  -power d         iterate z^d + c, 2 to %d (default 2)\n", MAX_POWER);
+	fprintf(stderr, "  -precision type  float, double or long, the arithmetic of the kernel (default float)\n");
+}
+
+static inline void tile_rect(const mandelview *view, int unit, int *x0, int *y0, int *w, int *h) { //Pixel rectangle covered by a work unit
+	*x0 = (unit % view->tilesX) * view->tileW;
+	*y0 = (unit / view->tilesX) * view->tileH;
+	*w = view->width - *x0 < view->tileW ? view->width - *x0 : view->tileW;
+	*h = view->height - *y0 < view->tileH ? view->height - *y0 : view->tileH;
+}
+
+static inline int deep_capable(const mandelview *view) { //The perturbation engine only knows the Mandelbrot set's z^2 + c
+	return !view->julia && view->power == 2;
+}
+
+static inline double min_pixel(const mandelview *view) { //Smallest pixel the view's kernel can still tell apart from its neighbours
+	return view->precision == PRECISION_FLOAT ? FLOAT_MIN_PIXEL : view->precision == PRECISION_DOUBLE || sizeof(long double) == sizeof(double) ? DOUBLE_MIN_PIXEL : LONG_MIN_PIXEL;
+}
+
+static inline long long floor_div(long long a, long long b) { //Division rounding towards minus infinity
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline double cut_decimal(const char *value, int places, char *out, size_t bytes) { //Cuts a plain decimal to places digits after the point, returns the part cut off
+	const char *p = value, *fraction;
+	char tail[24] = "0.";
+	int whole, digits, negative, length, i;
+	double cut;
+	while(*p == ' ')
+		++p;
+	negative = *p == '-';
+	if(*p == '-' || *p == '+')
+		++p;
+	whole = strspn(p, "0123456789");
+	fraction = p + whole + (p[whole] == '.');
+	digits = p[whole] == '.' ? (int)strspn(fraction, "0123456789") : 0;
+	if(places > (int)bytes - whole - 4)
+		places = (int)bytes - whole - 4;
+	length = snprintf(out, bytes, "%s%.*s.", negative ? "-" : "", whole ? whole : 1, whole ? p : "0");
+	for(i=0;i<places;++i) //Padded with zeros past the last digit given
+		out[length + i] = i < digits ? fraction[i] : '0';
+	out[length + places] = '\0';
+	if(digits > places)
+		strncat(tail, fraction + places, digits - places < 20 ? digits - places : 20);
+	cut = strtod(tail, NULL) * pow(10, -places);
+	return negative ? -cut : cut;
+}
+
+static inline int frame_pattern_ok(const char *pattern) { //Exactly one integer conversion such as %05d, and no other printf would read
+	int conversions = 0;
+	const char *p;
+	for(p=strchr(pattern, '%');p;p=strchr(p, '%')) {
+		if(*++p == '%') { //A literal percent sign
+			++p;
+			continue;
+		}
+		p += strspn(p, "-+ #0");
+		p += strspn(p, "0123456789");
+		if(*p != 'd' && *p != 'i')
+			return 0;
+		++conversions;
+	}
+	return conversions == 1;
+}
+
+static inline int parse_view(int argc, char *argv[], mandelview *view) { //Fills in the view from the command line, returns 0 on bad arguments
+	int i, tile = DEFAULT_TILE;
+	double region[4] = {0};
+	memset(view, 0, sizeof(mandelview));
+	view->centreRe = "0";
+	view->centreIm = "0";
+	view->zoom = 1;
+	view->width = DEFAULT_RESN;
+	view->height = DEFAULT_RESN;
+	view->maxIter = DEFAULT_MAX_ITER;
+	view->depth = DEFAULT_DEPTH;
+	view->window = DEFAULT_WINDOW;
+	view->cacheBytes = DEFAULT_CACHE_MB * 1048576L;
+	view->inFlight = DEFAULT_IN_FLIGHT;
+	view->power = 2;
+
+	for(i=1;i<argc;++i) {
+		if(strcmp(argv[i], "-c") == 0 && i + 2 < argc) {
+			view->centreRe = argv[++i];
+			view->centreIm = argv[++i];
+		}
+		else if(strcmp(argv[i], "-z") == 0 && i + 1 < argc)
+			view->zoom = strtod(argv[++i], NULL);
+		else if(strcmp(argv[i], "-s") == 0 && i + 2 < argc) {
+			view->width = atoi(argv[++i]);
+			view->height = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-region") == 0 && i + 4 < argc) {
+			int j;
+			for(j=0;j<4;++j)
+				region[j] = strtod(argv[++i], NULL);
+			if(region[1] <= region[0])
+				return 0;
+		}
+		else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			view->maxIter = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-deep") == 0)
+			view->deep = 1;
+		else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+			view->depth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			view->output = argv[++i];
+		else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			tile = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			view->window = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+			view->cacheDir = argv[++i];
+		else if(strcmp(argv[i], "-cachemb") == 0 && i + 1 < argc)
+			view->cacheBytes = atol(argv[++i]) * 1048576L;
+		else if(strcmp(argv[i], "-seq") == 0 && i + 1 < argc)
+			view->sequence = argv[++i];
+		else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			view->frames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			view->inFlight = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			view->threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-julia") == 0 && i + 2 < argc) {
+			view->julia = 1;
+			view->juliaRe = strtod(argv[++i], NULL);
+			view->juliaIm = strtod(argv[++i], NULL);
+		}
+		else if(strcmp(argv[i], "-power") == 0 && i + 1 < argc)
+			view->power = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-precision") == 0 && i + 1 < argc) {
+			++i;
+			if(strcmp(argv[i], "float") == 0)
+				view->precision = PRECISION_FLOAT;
+			else if(strcmp(argv[i], "double") == 0)
+				view->precision = PRECISION_DOUBLE;
+			else if(strcmp(argv[i], "long") == 0)
+				view->precision = PRECISION_LONG;
+			else
+				return 0;
+		}
+		else
+			return 0;
+	}
+	if(view->width < 1 || view->height < 1 || view->maxIter < 1 || view->depth < 1 || tile < 1 || view->window < 1 || view->frames < 0 || view->inFlight < 1 || view->threads < 0 || view->power < 2 || view->power > MAX_POWER)
+		return 0;
+	if(view->deep && !deep_capable(view))
+		return 0;
+	if(view->sequence) { //Frames are written from square tiles like a streamed image
+		if(view->cacheDir)
+			return 0;
+		if(!view->output)
+			view->output = DEFAULT_FRAME_NAME;
+		if(!frame_pattern_ok(view->output)) //The pattern is handed to snprintf for every frame
+			return 0;
+	}
+
+	if(region[1] > region[0]) { //Corners given, work out the centre and zoom they imply
+		snprintf(view->regionCentre[0], sizeof(view->regionCentre[0]), "%.17f", (region[0] + region[1]) / 2);
+		snprintf(view->regionCentre[1], sizeof(view->regionCentre[1]), "%.17f", (region[2] + region[3]) / 2);
+		view->centreRe = view->regionCentre[0];
+		view->centreIm = view->regionCentre[1];
+		view->zoom = DEFAULT_SPAN / (region[1] - region[0]);
+	}
+	if(view->zoom <= 0 || (view->cacheDir && view->output)) //The cache only serves renders to a window
+		return 0;
+
+	view->pixelSize = DEFAULT_SPAN / (view->zoom * view->width);
+	if(view->cacheDir) { //Snap to a power of two pixel size so tiles line up with runs at other zooms
+		view->level = (int)floor(log2(DEFAULT_SPAN / view->pixelSize) + 0.5);
+		view->pixelSize = ldexp(DEFAULT_SPAN, -view->level);
+		view->zoom = DEFAULT_SPAN / (view->pixelSize * view->width);
+	}
+	if(view->pixelSize < min_pixel(view) && deep_capable(view)) //Other kernels keep going at their own precision
+		view->deep = 1;
+
+	view->anchorRe = view->centreRe; //Deep views without a cache perturb from the centre itself
+	view->anchorIm = view->centreIm;
+	if(view->cacheDir) { //Whole tiles of a grid anchored at the origin, or for deep zooms at the centre cut to a coarse decimal
+		if(view->deep) { //Every view panned within the same decimal place shares the anchor, the grid and so the tiles
+			int places = (int)floor(-log10(view->pixelSize * DEEP_ANCHOR_PIXELS));
+			double cutRe, cutIm;
+			if(places < 0)
+				places = 0;
+			cutRe = cut_decimal(view->centreRe, places, view->anchorDigits[0], ANCHOR_BYTES);
+			cutIm = cut_decimal(view->centreIm, places, view->anchorDigits[1], ANCHOR_BYTES);
+			view->anchorRe = view->anchorDigits[0];
+			view->anchorIm = view->anchorDigits[1];
+			view->gridX0 = llround(cutRe / view->pixelSize) - view->width / 2;
+			view->gridY0 = -llround(cutIm / view->pixelSize) - view->height / 2;
+		}
+		else {
+			view->anchorRe = "0";
+			view->anchorIm = "0";
+			view->gridX0 = llround(atof(view->centreRe) / view->pixelSize) - view->width / 2;
+			view->gridY0 = -llround(atof(view->centreIm) / view->pixelSize) - view->height / 2;
+		}
+		view->tileW = tile;
+		view->tileH = tile;
+		view->tileX0 = floor_div(view->gridX0, tile);
+		view->tileY0 = floor_div(view->gridY0, tile);
+		view->tilesX = (int)(floor_div(view->gridX0 + view->width - 1, tile) - view->tileX0 + 1);
+		view->tilesY = (int)(floor_div(view->gridY0 + view->height - 1, tile) - view->tileY0 + 1);
+		view->tiles = view->tilesX * view->tilesY;
+		return 1;
+	}
+
+	if(view->output) { //Square tiles so the file can be read back a region at a time
+		view->tileW = tile;
+		view->tileH = tile;
+	}
+	else { //Whole lines straight into the window's image
+		view->tileW = view->width;
+		view->tileH = 1;
+	}
+	view->tilesX = (view->width + view->tileW - 1) / view->tileW;
+	view->tilesY = (view->height + view->tileH - 1) / view->tileH;
+	view->tiles = view->tilesX * view->tilesY;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef X11WINDOW_H
+#define X11WINDOW_H
+
+//Window setup shared by the drivers that draw to the screen.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+static inline Display *x11setup(Window *win, GC *gc, int width, int height) //Opens a width by height window and its graphics context, exits without an X server
+{
+	
+	/* --------------------------- X11 graphics setup ------------------------------ */
+	Display 		*display;
+	unsigned int 	win_x,win_y, /* window position */
+					border_width, /* border width in pixels */
+						screen; /* which screen */
+	
+	char 			window_name[] = "Mandelbrot", *display_name = NULL;
+	unsigned long 	valuemask = 0;
+	XGCValues 		values;
+	
+	XSizeHints 		size_hints;
+	
+	XSetWindowAttributes attr[1];
+	
+	if ( (display = XOpenDisplay (display_name)) == NULL ) { /* connect to Xserver */
+		fprintf (stderr, "Cannot connect to X server %s\n",XDisplayName (display_name) );
+		exit (-1);
+	}
+	
+	screen = DefaultScreen (display);
+	
+	win_x = 0; win_y = 0; /* set window position */
+	
+	border_width = 4; /* create opaque window */
+	*win = XCreateSimpleWindow (display, RootWindow (display, screen),
+			win_x, win_y, width, height, border_width,
+			WhitePixel (display, screen), BlackPixel (display, screen));
+			
+	size_hints.flags = USPosition|USSize;
+	size_hints.x = win_x;
+	size_hints.y = win_y;
+	size_hints.width = width;
+	size_hints.height = height;
+	size_hints.min_width = 300;
+	size_hints.min_height = 300;
+	
+	XSetNormalHints (display, *win, &size_hints);
+	XStoreName(display, *win, window_name);
+	
+	*gc = XCreateGC (display, *win, valuemask, &values); /* create graphics context */
+	
+	XSetBackground (display, *gc, BlackPixel (display, screen));
+	XSetForeground (display, *gc, WhitePixel (display, screen));
+	XSetLineAttributes (display, *gc, 1, LineSolid, CapRound, JoinRound);
+	
+	attr[0].backing_store = Always;
+	attr[0].backing_planes = 1;
+	attr[0].backing_pixel = BlackPixel(display, screen);
+	
+	XChangeWindowAttributes(display, *win, CWBackingStore | CWBackingPlanes | CWBackingPixel, attr);
+	
+	XSelectInput(display, *win, KeyPressMask);
+	
+	XMapWindow (display, *win);
+	XSync(display, 0);
+	
+	/* --------------------------- End of X11 graphics setup ------------------------------ */
+	return display;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+//Adaptive breeding, turned on with -adaptive. Each population, a node, an island or a node's thread, keeps its
+//own schedule. The operator for a pair is drawn by probability matching: every operator's quality is a
+//recency weighted average of the fitness its children gained over the better parent, and its probability
+//is its share of the total quality above a floor so no operator is ever dropped. The mutation rate is a
+//per symbol probability adapted by the 1/5 success rule: after every RATE_WINDOW mutations it grows if more
+//than a fifth of them made a child fitter than its parents and shrinks otherwise, between a quarter of a
+//symbol and half the symbols per genome.
+
+#include <math.h>
+
+#define OPERATOR_CROSSOVER 0
+#define OPERATOR_MUTATION 1
+#define OPERATOR_BOTH 2 //Crossover, then both children mutated
+#define OPERATORS 3
+#define MIN_OPERATOR_PROBABILITY 0.05
+#define QUALITY_WEIGHT 0.1 //Weight of the newest reward in an operator's quality
+#define RATE_WINDOW 50
+#define RATE_STEP 1.25
+
+typedef struct {
+  double quality[OPERATORS], probability[OPERATORS];
+  double mutationRate, minRate, maxRate;
+  int trials, successes; //Mutations in the current window, and how many improved on the parents
+  long uses[OPERATORS];
+} operatorSchedule;
+
+
+void initSchedule(operatorSchedule* schedule, int symbols) {
+  int op;
+  for(op=0;op<OPERATORS;++op) {
+    schedule->quality[op] = 0;
+    schedule->probability[op] = 1.0 / OPERATORS;
+    schedule->uses[op] = 0;
+  }
+  schedule->minRate = 0.25 / symbols;
+  schedule->maxRate = 0.5;
+  schedule->mutationRate = MUTATION_RATE / 100.0 < schedule->minRate ? schedule->minRate : MUTATION_RATE / 100.0;
+  schedule->trials = schedule->successes = 0;
+}
+
+
+int chooseOperator(const operatorSchedule* schedule) {
+  double draw = (rngNext(&weaselRandom) >> 11) * 0x1p-53;
+  int op;
+  for(op=0;op<OPERATORS-1;++op) {
+    if(draw < schedule->probability[op])
+      return op;
+    draw -= schedule->probability[op];
+  }
+  return OPERATORS - 1;
+}
+
+
+void rewardOperator(operatorSchedule* schedule, int op, int gain) {
+  double total = 0;
+  int i;
+  schedule->quality[op] += QUALITY_WEIGHT * ((gain > 0 ? gain : 0) - schedule->quality[op]);
+  for(i=0;i<OPERATORS;++i)
+    total += schedule->quality[i];
+  for(i=0;i<OPERATORS;++i)
+    schedule->probability[i] = total > 0 ? MIN_OPERATOR_PROBABILITY + (1 - OPERATORS * MIN_OPERATOR_PROBABILITY) * schedule->quality[i] / total : 1.0 / OPERATORS;
+}
+
+
+void recordMutation(operatorSchedule* schedule, int improved) {
+  schedule->successes += improved;
+  if(++schedule->trials < RATE_WINDOW)
+    return;
+  if(schedule->successes * 5 > schedule->trials)
+    schedule->mutationRate *= RATE_STEP;
+  else
+    schedule->mutationRate /= RATE_STEP;
+  if(schedule->mutationRate < schedule->minRate)
+    schedule->mutationRate = schedule->minRate;
+  if(schedule->mutationRate > schedule->maxRate)
+    schedule->mutationRate = schedule->maxRate;
+  schedule->trials = schedule->successes = 0;
+}
+
+
+int breedAdaptive(operatorSchedule* schedule, genomeWord* genome1, genomeWord* genome2, int parentFitness, int* childFitness) {
+  //Breeds the pair in place with a chosen operator, scores both children and feeds the result back
+  int op = chooseOperator(schedule), best;
+  if(op != OPERATOR_MUTATION)
+    crossOverGenomes(genome1, genome2);
+  if(op != OPERATOR_CROSSOVER) {
+    mutateSymbolsRate(&weaselGenome, genome1, schedule->mutationRate, &weaselRandom);
+    mutateSymbolsRate(&weaselGenome, genome2, schedule->mutationRate, &weaselRandom);
+  }
+  childFitness[0] = getFitness(genome1);
+  childFitness[1] = getFitness(genome2);
+  best = childFitness[0] > childFitness[1] ? childFitness[0] : childFitness[1];
+  rewardOperator(schedule, op, best - parentFitness);
+  if(op != OPERATOR_CROSSOVER)
+    recordMutation(schedule, best > parentFitness);
+  ++schedule->uses[op];
+  return op;
+}
+
+
+void breedGenomesAdaptive(operatorSchedule* schedule, genomeWord* genomes, int count) { //breedGenomes with a schedule, for nodes
+  int i, fitness1, fitness2, childFitness[2];
+  for(i=0;i<count;i+=2) {
+    fitness1 = getFitness(GENOME(genomes, i));
+    fitness2 = getFitness(GENOME(genomes, i+1));
+    breedAdaptive(schedule, GENOME(genomes, i), GENOME(genomes, i+1), fitness1 > fitness2 ? fitness1 : fitness2, childFitness);
+  }
+}
+
+
+void printSchedule(const operatorSchedule* schedule, const char* owner) {
+  printf("%s schedule: crossover %.2f, mutation %.2f, both %.2f (used %ld, %ld, %ld times), mutation rate %.3g per symbol\n", owner,
+    schedule->probability[OPERATOR_CROSSOVER], schedule->probability[OPERATOR_MUTATION], schedule->probability[OPERATOR_BOTH],
+    schedule->uses[OPERATOR_CROSSOVER], schedule->uses[OPERATOR_MUTATION], schedule->uses[OPERATOR_BOTH], schedule->mutationRate);
+}
+
+#endif
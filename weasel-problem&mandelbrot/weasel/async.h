@@ -0,0 +1,154 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+//Asynchronous steady state mode: no broadcast starts each generation. Every node streams its offspring to the
+//master and waits only for its own next parents, while the master takes offspring from whichever node
+//is ready with MPI_Waitany, folds them into the pool and answers that node straight away. A slow node
+//only slows itself. When the target turns up the master starts a one shot MPI_Ibcast the nodes posted at
+//the start and test between batches. A node that sees it sends a last empty message on ASYNC_DONE_TAG,
+//and the master keeps answering until it has one from every node, so no message is left unmatched.
+//Batches are -batch strings, or a pair without it.
+
+#define ASYNC_OFFSPRING_TAG 4
+#define ASYNC_PARENT_TAG 5
+#define ASYNC_DONE_TAG 6
+
+
+void asyncMasterLogic(int size) {
+  int i, node, nodes = size - 1, active = nodes, count = weaselBatch ? weaselBatch : 2, words = GENOMEWORDS;
+  int bestFitIndex, bestFitness, prevBest = MAX_NEGATIVE, found = 0;
+  long batches = 0, evaluations = POOLSIZE;
+  char text[DISPLAY_SYMBOLS + 4];
+  genomeWord* pool = allocGenomePool(&weaselGenome, POOLSIZE);
+  genomeWord* recvBuffers = allocGenomePool(&weaselGenome, nodes * count); //count genomes per node, in node order
+  genomeWord* sendBuffers = allocGenomePool(&weaselGenome, nodes * count);
+  int* poolFitness = malloc(POOLSIZE * sizeof(int));
+  MPI_Request* recvRequests = malloc(nodes * sizeof(MPI_Request));
+  MPI_Request* sendRequests = malloc(nodes * sizeof(MPI_Request));
+  MPI_Request foundRequest = MPI_REQUEST_NULL;
+  MPI_Status stat;
+  poolTree tree;
+  poolSelector selector;
+  FILE* bestStringsFile = weaselQuiet ? NULL : fopen("strings.txt", "w");
+  double time = MPI_Wtime(), waiting = 0, mark;
+
+  for(i=0;i<POOLSIZE;++i)
+    generateGenome(GENOME(pool, i));
+  getPoolFitness(pool, POOLSIZE, poolFitness);
+  initPoolTree(&tree, poolFitness, POOLSIZE);
+  initSelector(&selector, weaselSelection, weaselTournamentSize, poolFitness, POOLSIZE, ROULETTE_OFFSET);
+  bestFitness = poolFitness[bestPoolIndex(&tree)];
+  if(bestFitness == 0) { //Optimistically the solution is randomly generated
+    found = 1;
+    MPI_Ibcast(&found, 1, MPI_INT, MASTER, weaselComm, &foundRequest);
+  }
+
+  for(node=0;node<nodes;++node) {
+    sendRequests[node] = MPI_REQUEST_NULL;
+    MPI_Irecv(GENOME(recvBuffers, node * count), count * words, MPI_UINT64_T, node + 1, MPI_ANY_TAG, weaselComm, &recvRequests[node]);
+  }
+
+  while(active > 0) {
+    mark = MPI_Wtime();
+    MPI_Waitany(nodes, recvRequests, &node, &stat);
+    waiting += MPI_Wtime() - mark;
+    if(stat.MPI_TAG == ASYNC_DONE_TAG) { //The node has stopped, its request stays null
+      --active;
+      continue;
+    }
+
+    if(!found) { //Offspring that arrive after the target was found are just answered
+      evaluations += count;
+      for(i=0;i<count;++i)
+        insertGenome(pool, poolFitness, &tree, &selector, GENOME(recvBuffers, node * count + i), getFitness(GENOME(recvBuffers, node * count + i)));
+      ++batches;
+      bestFitIndex = bestPoolIndex(&tree);
+      bestFitness = poolFitness[bestFitIndex];
+      if(bestFitness == 0 && !weaselQuiet) {
+        printf("Target string found after %ld offspring batches!\n", batches);
+        printf("Target string: %s\n", genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text));
+        fprintf(bestStringsFile, "[%ld]\t%s\n", batches, text);
+      }
+      else if(prevBest != bestFitness && !weaselQuiet) {
+        prevBest = bestFitness;
+        printf("[%ld]\t%s %d\n", batches, genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text), bestFitness);
+        fprintf(bestStringsFile, "[%ld]\t%s\n", batches, text);
+      }
+      if(bestFitness == 0 || (weaselGenerationLimit && batches >= weaselGenerationLimit)) { //Found, or given up
+        found = 1;
+        MPI_Ibcast(&found, 1, MPI_INT, MASTER, weaselComm, &foundRequest);
+      }
+    }
+
+    mark = MPI_Wtime();
+    MPI_Wait(&sendRequests[node], MPI_STATUS_IGNORE);
+    waiting += MPI_Wtime() - mark; //Already received, the node only sends after getting its last parents
+    for(i=0;i<count;++i)
+      memcpy(GENOME(sendBuffers, node * count + i), GENOME(pool, selectString(&selector)), words * sizeof(genomeWord));
+    MPI_Isend(GENOME(sendBuffers, node * count), count * words, MPI_UINT64_T, node + 1, ASYNC_PARENT_TAG, weaselComm, &sendRequests[node]);
+    MPI_Irecv(GENOME(recvBuffers, node * count), count * words, MPI_UINT64_T, node + 1, MPI_ANY_TAG, weaselComm, &recvRequests[node]);
+  }
+  mark = MPI_Wtime();
+  MPI_Waitall(nodes, sendRequests, MPI_STATUSES_IGNORE);
+  MPI_Wait(&foundRequest, MPI_STATUS_IGNORE);
+  waiting += MPI_Wtime() - mark;
+  MPI_Reduce(MPI_IN_PLACE, &evaluations, 1, MPI_LONG, MPI_SUM, MASTER, weaselComm);
+
+  time = MPI_Wtime() - time;
+  weaselLastRun = (weaselRun){batches, evaluations, time, time - waiting, bestFitness == 0};
+  if(!weaselQuiet) {
+    printf("%ld offspring batches of %d in %f seconds, %.0f batches/s\n", batches, count, time, batches / time);
+    printf("%ld fitness evaluations, %.0f/s, master busy %.0f%% of the time\n", evaluations, evaluations / time, 100 * (time - waiting) / time);
+    fclose(bestStringsFile);
+  }
+  freePoolTree(&tree);
+  freeSelector(&selector);
+  free(pool);
+  free(recvBuffers);
+  free(sendBuffers);
+  free(poolFitness);
+  free(recvRequests);
+  free(sendRequests);
+}
+
+
+void asyncNodeLogic(int rank) {
+  int i, mode = (rank % 2 == 0 ? 0 : 1), found = 0, flag = 0, count = weaselBatch ? weaselBatch : 2, words = GENOMEWORDS;
+  long evaluations = 0;
+  genomeWord* genomes = allocGenomePool(&weaselGenome, count);
+  MPI_Request foundRequest;
+  localPopulation local;
+  operatorSchedule schedule;
+
+  initSchedule(&schedule, TARGETLEN);
+  if(weaselThreads)
+    initLocalPopulation(&local, weaselLocalSize, weaselThreads, weaselLocalGenerations, rank);
+
+  MPI_Ibcast(&found, 1, MPI_INT, MASTER, weaselComm, &foundRequest); //Completes once the master has the target
+  for(i=0;i<count;++i)
+    generateGenome(GENOME(genomes, i));
+
+  while(!flag) {
+    MPI_Send(genomes, count * words, MPI_UINT64_T, MASTER, ASYNC_OFFSPRING_TAG, weaselComm);
+    MPI_Recv(genomes, count * words, MPI_UINT64_T, MASTER, ASYNC_PARENT_TAG, weaselComm, MPI_STATUS_IGNORE); //Every batch sent is answered
+    if(weaselThreads)
+      evolveLocal(&local, genomes, count);
+    else if(weaselAdaptive) {
+      breedGenomesAdaptive(&schedule, genomes, count);
+      evaluations += 2 * count; //Parents and children are scored to reward the operator
+    }
+    else
+      breedGenomes(genomes, count, mode);
+    mode = !mode;
+    MPI_Test(&foundRequest, &flag, MPI_STATUS_IGNORE);
+  }
+  MPI_Send(NULL, 0, MPI_UINT64_T, MASTER, ASYNC_DONE_TAG, weaselComm);
+  if(weaselThreads) {
+    evaluations = localEvaluations(&local);
+    freeLocalPopulation(&local);
+  }
+  MPI_Reduce(&evaluations, NULL, 1, MPI_LONG, MPI_SUM, MASTER, weaselComm);
+  free(genomes);
+}
+
+#endif
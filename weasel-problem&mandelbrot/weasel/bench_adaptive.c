@@ -0,0 +1,129 @@
+int benchBounded; //Which of the two solvers' acceptance rules the runs use
+#define WEASEL_ACCEPT(strFit, worstFitness, diverse) (benchBounded ? BOUNDED_ACCEPT(strFit, worstFitness, diverse) : DEFAULT_ACCEPT(strFit, worstFitness, diverse))
+#include "weasel.h"
+
+//Compares adaptive breeding from adaptive.h with the fixed operators, under the acceptance rules of both weasel.c
+//and bounded_weasel.c. Each run is the serial steady state GA of bench_selection: two parents selected,
+//bred and both children offered to the pool, and the same seeds are used for every variant. Reports the
+//mean and median generations to the target and the mean wall time, then the last adaptive schedule.
+//Runs on one process, mpicc is only needed because weasel.h brings in the MPI solvers.
+//Usage: bench_adaptive [-runs count] [-pool size] [-target string | -randomtarget length]
+
+#define BENCH_RUNS 10
+#define MAX_GENERATIONS 2000000 //A run that has not converged by now counts as a failure
+
+const char* variantNames[] = {"weasel fixed", "weasel adaptive", "bounded fixed", "bounded adaptive"};
+
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+int compareInts(const void* a, const void* b) {
+  return *(const int*)a - *(const int*)b;
+}
+
+
+int solve(int adaptive, uint64_t seed, operatorSchedule* schedule, double* seconds) { //Generations to find the target, MAX_GENERATIONS if it was not found
+  int i, child, generation, parent1, parent2, childFitness[2];
+  genomeWord* pool = allocGenomePool(&weaselGenome, POOLSIZE);
+  genomeWord* genomes = allocGenomePool(&weaselGenome, 2);
+  int* poolFitness = malloc(POOLSIZE * sizeof(int));
+  poolTree tree;
+  poolSelector selector;
+  double start = now();
+
+  rngSeed(&weaselRandom, seed, 0, 0);
+  initSchedule(schedule, TARGETLEN);
+  for(i=0;i<POOLSIZE;++i)
+    generateGenome(GENOME(pool, i));
+  getPoolFitness(pool, POOLSIZE, poolFitness);
+  initPoolTree(&tree, poolFitness, POOLSIZE);
+  initSelector(&selector, weaselSelection, weaselTournamentSize, poolFitness, POOLSIZE, ROULETTE_OFFSET);
+  for(generation=1;generation<MAX_GENERATIONS && poolFitness[bestPoolIndex(&tree)] < 0;++generation) {
+    parent1 = selectString(&selector);
+    parent2 = selectString(&selector);
+    memcpy(GENOME(genomes, 0), GENOME(pool, parent1), GENOMEWORDS * sizeof(genomeWord));
+    memcpy(GENOME(genomes, 1), GENOME(pool, parent2), GENOMEWORDS * sizeof(genomeWord));
+    if(adaptive)
+      breedAdaptive(schedule, GENOME(genomes, 0), GENOME(genomes, 1), poolFitness[parent1] > poolFitness[parent2] ? poolFitness[parent1] : poolFitness[parent2], childFitness);
+    else {
+      crossOverGenomes(GENOME(genomes, 0), GENOME(genomes, 1));
+      mutateGenome(GENOME(genomes, 0));
+      mutateGenome(GENOME(genomes, 1));
+      getPoolFitness(genomes, 2, childFitness);
+    }
+    for(child=0;child<2;++child)
+      insertGenome(pool, poolFitness, &tree, &selector, GENOME(genomes, child), childFitness[child]);
+  }
+  *seconds = now() - start;
+  freePoolTree(&tree);
+  freeSelector(&selector);
+  free(pool);
+  free(genomes);
+  free(poolFitness);
+  return generation;
+}
+
+
+int main(int argc, char** argv) {
+  int i, variant, run, runs = BENCH_RUNS, randomLength = 0, solved;
+  int* generations;
+  double seconds, totalSeconds, totalGenerations;
+  char* target = NULL;
+  operatorSchedule schedule;
+
+  for(i=1;i<argc;++i) {
+    if(strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-pool") == 0 && i + 1 < argc)
+      weaselPoolSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+      targetStr = argv[++i];
+    else if(strcmp(argv[i], "-randomtarget") == 0 && i + 1 < argc)
+      randomLength = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [-runs count] [-pool size] [-target string | -randomtarget length]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(randomLength > 0) { //From its own stream, so every variant chases the same target
+    target = malloc(randomLength + 1);
+    rngSeed(&weaselRandom, 0, 0, 0);
+    for(i=0;i<randomLength;++i)
+      target[i] = validChars[rngBelow(&weaselRandom, VALIDLEN)];
+    target[randomLength] = '\0';
+    targetStr = target;
+  }
+  if(runs < 1 || POOLSIZE < 2 || strlen(targetStr) == 0 || strspn(targetStr, validChars) != strlen(targetStr))
+    return 1;
+  initFitnessTables(&weaselTables, validChars, targetStr);
+  initGenomeLayout(&weaselGenome, &weaselTables, validChars, targetStr);
+  generations = malloc(runs * sizeof(int));
+
+  printf("Time to solution for %d symbols, pool %d, seeds 1 to %d\n", TARGETLEN, POOLSIZE, runs);
+  for(variant=0;variant<4;++variant) {
+    benchBounded = variant >= 2;
+    totalSeconds = totalGenerations = solved = 0;
+    for(run=0;run<runs;++run) {
+      generations[run] = solve(variant % 2, run + 1, &schedule, &seconds);
+      totalSeconds += seconds;
+      totalGenerations += generations[run];
+      solved += generations[run] < MAX_GENERATIONS;
+    }
+    qsort(generations, runs, sizeof(int), compareInts);
+    printf("%-18s %10.0f mean %10d median generations %10.3f seconds, %d of %d solved\n", variantNames[variant],
+      totalGenerations / runs, generations[runs / 2], totalSeconds / runs, solved, runs);
+    if(variant % 2)
+      printSchedule(&schedule, "  Last run's");
+  }
+
+  free(generations);
+  freeGenomeLayout(&weaselGenome);
+  freeFitnessTables(&weaselTables);
+  free(target);
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "genome.h"
+
+//Evaluations per second for the table driven string fitness and the two packed genome fitness paths the GA uses,
+//against the original strlen and findChar version, on a random target. packedFitness only looks at the symbols
+//that differ from the target and batchFitness at all of them, so both are timed on a pool of random genomes and
+//on one of copies of the target with -near of their symbols changed, as a pool is once the GA closes in.
+//-alphabet changes the bits per symbol. Serial, no MPI needed.
+//Usage: bench_fitness [-n poolSize] [-l targetLength] [-sample strings] [-reps passes] [-near rate] [-alphabet chars]
+//The string versions are timed over the first sample strings of the random pool, the packed ones over all of it.
+
+#define DEFAULT_POOL 1000000
+#define DEFAULT_LENGTH 1024
+#define DEFAULT_SAMPLE 10000
+#define DEFAULT_REPS 3
+#define DEFAULT_NEAR 0.01
+
+const char* validChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+
+
+int findChar(char key, const char* characterSet) { //The original fitness, kept here as the baseline
+  int i, len = strlen(characterSet);
+  for(i=0;i<len;++i)
+    if(characterSet[i] == key)
+      break;
+  return i;
+}
+
+
+int legacyFitness(const char* candidate, const char* targetStr) {
+  int targetPos, candidatePos, currentFitness = 0;
+  size_t i, length = strlen(targetStr);
+  for(i=0;i<length;++i) {
+    targetPos = findChar(targetStr[i], validChars);
+    candidatePos = findChar(candidate[i], validChars);
+    int difference = abs(targetPos - candidatePos);
+    int wrapped = (int)strlen(validChars) - difference;
+    currentFitness -= difference < wrapped ? difference : wrapped;
+  }
+  return currentFitness;
+}
+
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+void report(const char* name, long evaluations, double seconds, long long checksum) {
+  printf("%-22s %12.0f evaluations/s %10.3f us/evaluation  checksum %lld\n", name, evaluations / seconds, seconds * 1e6 / evaluations, checksum);
+}
+
+
+int main(int argc, char** argv) {
+  long i, pool = DEFAULT_POOL, sample = DEFAULT_SAMPLE;
+  int j, rep, length = DEFAULT_LENGTH, reps = DEFAULT_REPS, mismatches = 0;
+  long long legacySum = 0, stringSum = 0, randomSum = 0, nearSum = 0, batchRandomSum = 0, batchNearSum = 0;
+  double start, near = DEFAULT_NEAR;
+  fitnessTables tables;
+  genomeLayout layout;
+  rngState rng;
+
+  for(i=1;i<argc;++i) {
+    if(!strcmp(argv[i], "-n") && i + 1 < argc)
+      pool = atol(argv[++i]);
+    else if(!strcmp(argv[i], "-l") && i + 1 < argc)
+      length = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-sample") && i + 1 < argc)
+      sample = atol(argv[++i]);
+    else if(!strcmp(argv[i], "-reps") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-near") && i + 1 < argc)
+      near = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-alphabet") && i + 1 < argc)
+      validChars = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [-n poolSize] [-l targetLength] [-sample strings] [-reps passes] [-near rate] [-alphabet chars]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(pool < 1 || length < 1 || reps < 1 || near <= 0 || near >= 1 || strlen(validChars) < 2 || strlen(validChars) > 255)
+    return 1;
+  if(sample > pool)
+    sample = pool;
+
+  rngSeed(&rng, 1, 0, 0);
+  char* targetStr = malloc(length + 1);
+  for(j=0;j<length;++j)
+    targetStr[j] = validChars[rngBelow(&rng, strlen(validChars))];
+  targetStr[length] = '\0';
+  initFitnessTables(&tables, validChars, targetStr);
+  initGenomeLayout(&layout, &tables, validChars, targetStr);
+
+  genomeWord* randomPool = allocGenomePool(&layout, pool);
+  genomeWord* nearPool = allocGenomePool(&layout, pool);
+  char* strings = malloc((size_t)sample * (length + 1));
+  int* fitnesses = malloc(pool * sizeof(int)), *batchFitnesses = malloc(pool * sizeof(int));
+  if(!randomPool || !nearPool || !strings || !fitnesses || !batchFitnesses) {
+    fprintf(stderr, "Could not allocate pools of %ld genomes of %d words\n", pool, layout.words);
+    return 1;
+  }
+  for(i=0;i<pool;++i) {
+    randomGenome(&layout, genomeAt(&layout, randomPool, i), &rng);
+    memcpy(genomeAt(&layout, nearPool, i), layout.target, layout.words * sizeof(genomeWord));
+    mutateSymbolsRate(&layout, genomeAt(&layout, nearPool, i), near, &rng);
+  }
+  for(i=0;i<sample;++i) { //Every symbol, genomeText cuts long genomes short
+    for(j=0;j<length;++j)
+      strings[(size_t)i * (length + 1) + j] = validChars[genomeSymbol(&layout, genomeAt(&layout, randomPool, i), j)];
+    strings[(size_t)i * (length + 1) + length] = '\0';
+  }
+  printf("Pool of %ld genomes, target length %d, %d bits a symbol, %d words a genome, %.1f MB packed\n", pool, length, layout.bits, layout.words,
+         (double)pool * layout.words * sizeof(genomeWord) / 1e6);
+
+  start = now(); //The baseline is slow enough that one pass over the sample is plenty
+  for(i=0;i<sample;++i)
+    legacySum += legacyFitness(strings + (size_t)i * (length + 1), targetStr);
+  report("strlen and findChar", sample, now() - start, legacySum);
+
+  start = now();
+  for(rep=0;rep<reps;++rep)
+    for(i=0;i<sample;++i)
+      stringSum += stringFitness(&tables, strings + (size_t)i * (length + 1));
+  report("stringFitness", sample * reps, now() - start, stringSum / reps);
+
+  start = now();
+  for(rep=0;rep<reps;++rep)
+    for(i=0;i<pool;++i)
+      fitnesses[i] = packedFitness(&layout, genomeAt(&layout, randomPool, i));
+  double randomTime = now() - start;
+  for(i=0;i<pool;++i)
+    randomSum += fitnesses[i];
+  report("packedFitness random", pool * reps, randomTime, randomSum);
+
+  for(i=0;i<sample;++i) //Every path has to agree with the table driven string version
+    if(fitnesses[i] != stringFitness(&tables, strings + (size_t)i * (length + 1)))
+      ++mismatches;
+  for(i=0;i<sample && i<100;++i) //A few against the baseline, which is too slow to repeat for all of them
+    if(fitnesses[i] != legacyFitness(strings + (size_t)i * (length + 1), targetStr))
+      ++mismatches;
+
+  start = now();
+  for(rep=0;rep<reps;++rep)
+    batchFitness(&layout, randomPool, pool, batchFitnesses);
+  double batchTime = now() - start;
+  for(i=0;i<pool;++i) {
+    batchRandomSum += batchFitnesses[i];
+    if(batchFitnesses[i] != fitnesses[i])
+      ++mismatches;
+  }
+  report("batchFitness random", pool * reps, batchTime, batchRandomSum);
+
+  start = now();
+  for(rep=0;rep<reps;++rep)
+    for(i=0;i<pool;++i)
+      fitnesses[i] = packedFitness(&layout, genomeAt(&layout, nearPool, i));
+  double nearTime = now() - start;
+  for(i=0;i<pool;++i)
+    nearSum += fitnesses[i];
+  report("packedFitness near", pool * reps, nearTime, nearSum);
+
+  start = now();
+  for(rep=0;rep<reps;++rep)
+    batchFitness(&layout, nearPool, pool, batchFitnesses);
+  batchTime = now() - start;
+  for(i=0;i<pool;++i) {
+    batchNearSum += batchFitnesses[i];
+    if(batchFitnesses[i] != fitnesses[i])
+      ++mismatches;
+  }
+  report("batchFitness near", pool * reps, batchTime, batchNearSum);
+  printf("%d mismatches\n", mismatches);
+
+  freeGenomeLayout(&layout);
+  freeFitnessTables(&tables);
+  free(randomPool);
+  free(nearPool);
+  free(strings);
+  free(fitnesses);
+  free(batchFitnesses);
+  free(targetStr);
+  return mismatches != 0;
+}
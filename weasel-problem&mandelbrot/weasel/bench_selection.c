@@ -0,0 +1,128 @@
+#include "weasel.h"
+
+//Compares the selection strategies in selection.h. First selections per second on random pools of growing size,
+//then time to solution for a serial steady state GA built from the same pieces the solvers use: two parents
+//selected, crossed over and mutated, and both children offered to the pool through insertGenome.
+//Runs on one process, mpicc is only needed because weasel.h brings in the MPI solvers.
+//Usage: bench_selection [-runs count] [-pool size] [-k tournamentSize] [-target string]
+
+#define BENCH_SELECTIONS 200000
+#define BENCH_RUNS 5
+#define MAX_GENERATIONS 1000000 //A run that has not converged by now counts as a failure
+
+const char* strategyNames[] = {"biased", "roulette", "tournament"};
+
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+double selectionsPerSecond(int strategy, int count) {
+  int i, selections = strategy == SELECTION_BIASED ? BENCH_SELECTIONS / (count / 1000 + 1) + 1 : BENCH_SELECTIONS; //Biased is O(n), fewer draws keep it quick
+  int* fitness = malloc(count * sizeof(int));
+  long long sum = 0;
+  poolSelector selector;
+  double start;
+
+  for(i=0;i<count;++i)
+    fitness[i] = -(int)rngBelow(&weaselRandom, ROULETTE_OFFSET);
+  initSelector(&selector, strategy, weaselTournamentSize, fitness, count, ROULETTE_OFFSET);
+  start = now();
+  for(i=0;i<selections;++i)
+    sum += selectString(&selector);
+  start = now() - start;
+  if(sum < 0) //Keeps the draws from being optimised away
+    printf("%lld\n", sum);
+  freeSelector(&selector);
+  free(fitness);
+  return selections / start;
+}
+
+
+int solve(int strategy, double* seconds) { //Generations to find the target, MAX_GENERATIONS if it was not found
+  int i, child, generation;
+  genomeWord* pool = allocGenomePool(&weaselGenome, POOLSIZE);
+  genomeWord* genomes = allocGenomePool(&weaselGenome, 2);
+  int* poolFitness = malloc(POOLSIZE * sizeof(int));
+  poolTree tree;
+  poolSelector selector;
+  double start = now();
+
+  for(i=0;i<POOLSIZE;++i)
+    generateGenome(GENOME(pool, i));
+  getPoolFitness(pool, POOLSIZE, poolFitness);
+  initPoolTree(&tree, poolFitness, POOLSIZE);
+  initSelector(&selector, strategy, weaselTournamentSize, poolFitness, POOLSIZE, ROULETTE_OFFSET);
+  for(generation=1;generation<MAX_GENERATIONS && poolFitness[bestPoolIndex(&tree)] < 0;++generation) {
+    memcpy(GENOME(genomes, 0), GENOME(pool, selectString(&selector)), GENOMEWORDS * sizeof(genomeWord));
+    memcpy(GENOME(genomes, 1), GENOME(pool, selectString(&selector)), GENOMEWORDS * sizeof(genomeWord));
+    crossOverGenomes(GENOME(genomes, 0), GENOME(genomes, 1));
+    mutateGenome(GENOME(genomes, 0));
+    mutateGenome(GENOME(genomes, 1));
+    for(child=0;child<2;++child)
+      insertGenome(pool, poolFitness, &tree, &selector, GENOME(genomes, child), getFitness(GENOME(genomes, child)));
+  }
+  *seconds = now() - start;
+  freePoolTree(&tree);
+  freeSelector(&selector);
+  free(pool);
+  free(genomes);
+  free(poolFitness);
+  return generation;
+}
+
+
+int main(int argc, char** argv) {
+  int i, strategy, count, run, runs = BENCH_RUNS, generations, solved;
+  double seconds, totalSeconds, totalGenerations;
+
+  for(i=1;i<argc;++i) {
+    if(strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-pool") == 0 && i + 1 < argc)
+      weaselPoolSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+      weaselTournamentSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+      targetStr = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [-runs count] [-pool size] [-k tournamentSize] [-target string]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(runs < 1 || POOLSIZE < 2 || weaselTournamentSize < 1 || strspn(targetStr, validChars) != strlen(targetStr))
+    return 1;
+  initFitnessTables(&weaselTables, validChars, targetStr);
+  initGenomeLayout(&weaselGenome, &weaselTables, validChars, targetStr);
+  rngSeed(&weaselRandom, 1, 0, 0);
+
+  printf("Selections per second, tournament size %d\n%-12s", weaselTournamentSize, "pool");
+  for(strategy=SELECTION_BIASED;strategy<=SELECTION_TOURNAMENT;++strategy)
+    printf(" %14s", strategyNames[strategy]);
+  printf("\n");
+  for(count=1000;count<=1000000;count*=10) {
+    printf("%-12d", count);
+    for(strategy=SELECTION_BIASED;strategy<=SELECTION_TOURNAMENT;++strategy)
+      printf(" %14.0f", selectionsPerSecond(strategy, count));
+    printf("\n");
+  }
+
+  printf("\nTime to solution for \"%s\", pool %d, mean of %d runs\n", targetStr, POOLSIZE, runs);
+  for(strategy=SELECTION_BIASED;strategy<=SELECTION_TOURNAMENT;++strategy) {
+    totalSeconds = totalGenerations = solved = 0;
+    for(run=0;run<runs;++run) {
+      generations = solve(strategy, &seconds);
+      totalSeconds += seconds;
+      totalGenerations += generations;
+      solved += generations < MAX_GENERATIONS;
+    }
+    printf("%-12s %10.0f generations %10.3f seconds, %d of %d solved\n", strategyNames[strategy], totalGenerations / runs, totalSeconds / runs, solved, runs);
+  }
+
+  freeGenomeLayout(&weaselGenome);
+  freeFitnessTables(&weaselTables);
+  return 0;
+}
@@ -0,0 +1,259 @@
+int benchBounded; //Which of the two solvers' acceptance rules the runs use
+#define WEASEL_ACCEPT(strFit, worstFitness, diverse) (benchBounded ? BOUNDED_ACCEPT(strFit, worstFitness, diverse) : DEFAULT_ACCEPT(strFit, worstFitness, diverse))
+#include "weasel.h"
+
+//Time to solution for the weasel solvers. Every variant runs over seeds 1 to -seeds for every rank count, pool
+//size and target length, on the first n ranks of MPI_COMM_WORLD through weaselComm, so one job covers
+//the whole sweep. Targets are random strings of each length, the same for every variant and seed.
+//A run records the generations it took (iterations, offspring batches or island generations), wall time,
+//fitness evaluations per second over every rank and the fraction of the time the master was not waiting
+//on nodes. Runs that hit -maxgens count as unsolved. Each configuration is summarised by median and p90
+//on stdout and in prefix.csv, prefix.json has the summaries and every run.
+//Usage: mpirun -np N bench_weasel [-seeds count] [-ranks list] [-pools list] [-lengths list] [-variants list] [-maxgens generations] [-o prefix]
+//Lists are comma separated, rank counts default to 2, 4, 8 ... and then every rank.
+
+#define BENCH_SEEDS 5
+#define BENCH_BATCH 8 //Strings per node per message in the batch variants
+#define BENCH_GENERATION_LIMIT 200000
+#define MAX_SWEEP 32 //Longest list for any one sweep
+
+#define MODE_SYNC 0
+#define MODE_BATCH 1
+#define MODE_ASYNC 2
+#define MODE_ISLAND 3
+
+typedef struct {
+  const char* name;
+  int bounded; //bounded_weasel.c's acceptance rule rather than weasel.c's
+  int mode;
+} benchVariant;
+
+static const benchVariant variants[] = {
+  {"weasel", 0, MODE_SYNC}, //What weasel.c and bounded_weasel.c run by default
+  {"bounded", 1, MODE_SYNC},
+  {"weasel-batch", 0, MODE_BATCH},
+  {"bounded-batch", 1, MODE_BATCH},
+  {"weasel-async", 0, MODE_ASYNC},
+  {"bounded-async", 1, MODE_ASYNC},
+  {"weasel-island", 0, MODE_ISLAND},
+  {"bounded-island", 1, MODE_ISLAND}
+};
+
+#define VARIANTS ((int)(sizeof(variants) / sizeof(variants[0])))
+
+typedef struct { //Median and p90 of one measure over the seeds
+  double median, p90, mean;
+} benchSummary;
+
+
+int parseList(char* str, int* values) { //Comma separated positive integers, how many or 0 if malformed
+  int count = 0;
+  char* p;
+  for(p=strtok(str, ",");p && count<MAX_SWEEP;p=strtok(NULL, ","))
+    if((values[count++] = atoi(p)) < 1)
+      return 0;
+  return p ? 0 : count;
+}
+
+
+int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+
+benchSummary summarise(double* values, int count) { //Sorts values, p90 is the nearest rank
+  benchSummary summary = {0, 0, 0};
+  int i;
+  qsort(values, count, sizeof(double), compareDoubles);
+  for(i=0;i<count;++i)
+    summary.mean += values[i] / count;
+  summary.median = count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+  summary.p90 = values[(9 * count + 9) / 10 - 1];
+  return summary;
+}
+
+
+char* randomTarget(int length) { //The same on every rank, from a stream the solvers never use
+  char* target = malloc(length + 1);
+  rngState rng;
+  int i;
+  rngSeed(&rng, length, 0, 1);
+  for(i=0;i<length;++i)
+    target[i] = validChars[rngBelow(&rng, strlen(validChars))];
+  target[length] = '\0';
+  return target;
+}
+
+
+void runVariant(const benchVariant* variant, int rank, int size, unsigned long long seed) { //One solve on weaselComm
+  islandConfig config = {DEFAULT_MIGRATION_INTERVAL, DEFAULT_MIGRANTS, TOPOLOGY_RING};
+  benchBounded = variant->bounded;
+  weaselBatch = variant->mode == MODE_BATCH ? BENCH_BATCH : 0;
+  weaselSeed = seed;
+  rngSeed(&weaselRandom, seed, rank, 0);
+  MPI_Barrier(weaselComm); //Every rank starts the clock together
+  if(variant->mode == MODE_ISLAND)
+    islandLogic(rank, size, &config);
+  else if(variant->mode == MODE_ASYNC && rank == MASTER)
+    asyncMasterLogic(size);
+  else if(variant->mode == MODE_ASYNC)
+    asyncNodeLogic(rank);
+  else if(rank == MASTER)
+    masterLogic(size);
+  else
+    nodeLogic(rank);
+}
+
+
+void printSummary(FILE* csv, FILE* json, const benchVariant* variant, int ranks, int length, int seeds, int solved, benchSummary* summaries) {
+  const char* names[] = {"generations", "wall_s", "evaluations_s", "master_busy"};
+  int m;
+  printf("%-15s %5d %7d %6d %3d/%-3d %10.0f %10.0f %9.4f %9.4f %11.0f %6.2f\n", variant->name, ranks, POOLSIZE, length, solved, seeds,
+    summaries[0].median, summaries[0].p90, summaries[1].median, summaries[1].p90, summaries[2].median, summaries[3].median);
+  fprintf(csv, "%s,%d,%d,%d,%d,%d,%d", variant->name, variant->bounded, ranks, POOLSIZE, length, seeds, solved);
+  for(m=0;m<4;++m)
+    fprintf(csv, ",%f,%f,%f", summaries[m].median, summaries[m].p90, summaries[m].mean);
+  fprintf(csv, "\n");
+  fprintf(json, "\"variant\": \"%s\", \"bounded\": %d, \"ranks\": %d, \"pool\": %d, \"length\": %d, \"seeds\": %d, \"solved\": %d",
+    variant->name, variant->bounded, ranks, POOLSIZE, length, seeds, solved);
+  for(m=0;m<4;++m)
+    fprintf(json, ", \"%s\": {\"median\": %f, \"p90\": %f, \"mean\": %f}", names[m], summaries[m].median, summaries[m].p90, summaries[m].mean);
+}
+
+
+int main(int argc, char** argv) {
+  int i, rank, worldSz, seeds = BENCH_SEEDS, first = 1, r, l, v, s;
+  int ranks[MAX_SWEEP], pools[MAX_SWEEP] = {DEFAULT_POOLSIZE}, lengths[MAX_SWEEP] = {6, 28};
+  int rankCount = 0, poolCount = 1, lengthCount = 2, chosen[VARIANTS], smallPool = 0;
+  const char* prefix = "bench_weasel";
+  char name[1024], *p;
+  FILE *csv = NULL, *json = NULL;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_size(MPI_COMM_WORLD, &worldSz);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  weaselQuiet = 1;
+  weaselGenerationLimit = BENCH_GENERATION_LIMIT;
+  for(v=0;v<VARIANTS;++v)
+    chosen[v] = 1;
+
+  for(i=1;i<argc;++i) {
+    if(strcmp(argv[i], "-seeds") == 0 && i + 1 < argc)
+      seeds = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-ranks") == 0 && i + 1 < argc)
+      rankCount = parseList(argv[++i], ranks);
+    else if(strcmp(argv[i], "-pools") == 0 && i + 1 < argc)
+      poolCount = parseList(argv[++i], pools);
+    else if(strcmp(argv[i], "-lengths") == 0 && i + 1 < argc)
+      lengthCount = parseList(argv[++i], lengths);
+    else if(strcmp(argv[i], "-maxgens") == 0 && i + 1 < argc)
+      weaselGenerationLimit = atol(argv[++i]);
+    else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      prefix = argv[++i];
+    else if(strcmp(argv[i], "-variants") == 0 && i + 1 < argc) {
+      for(v=0;v<VARIANTS;++v)
+        chosen[v] = 0;
+      for(p=strtok(argv[++i], ",");p;p=strtok(NULL, ",")) {
+        for(v=0;v<VARIANTS && strcmp(p, variants[v].name) != 0;++v);
+        if(v == VARIANTS)
+          break;
+        chosen[v] = 1;
+      }
+      if(p)
+        break;
+    }
+    else
+      break;
+  }
+  if(rankCount == 0 && i == argc) //Powers of two, then every rank
+    for(r=2;rankCount<MAX_SWEEP;r=r*2>worldSz ? worldSz : r*2) {
+      ranks[rankCount++] = r;
+      if(r >= worldSz)
+        break;
+    }
+  for(r=0;r<rankCount && ranks[r]>=2 && ranks[r]<=worldSz;++r);
+  for(l=0;l<poolCount;++l) //A pool must hold the island migrants
+    smallPool |= pools[l] < DEFAULT_MIGRANTS;
+  if(i < argc || seeds < 1 || r < rankCount || rankCount == 0 || poolCount == 0 || lengthCount == 0 || smallPool || weaselGenerationLimit < 0) {
+    if(rank == MASTER)
+      fprintf(stderr, "Usage: %s [-seeds count] [-ranks list] [-pools list] [-lengths list] [-variants list] [-maxgens generations] [-o prefix]\n"
+        "  Rank counts run from 2 to the job's %d ranks, variants are weasel, bounded and either with -batch, -async or -island\n", argv[0], worldSz);
+    MPI_Finalize();
+    return 1;
+  }
+
+  if(rank == MASTER) {
+    snprintf(name, sizeof(name), "%s.csv", prefix);
+    csv = fopen(name, "w");
+    snprintf(name, sizeof(name), "%s.json", prefix);
+    json = fopen(name, "w");
+    if(!csv || !json) {
+      fprintf(stderr, "Cannot write results to %s.csv and %s.json\n", prefix, prefix);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    fprintf(csv, "variant,bounded,ranks,pool,length,seeds,solved,generations_median,generations_p90,generations_mean,wall_s_median,wall_s_p90,wall_s_mean,"
+      "evaluations_s_median,evaluations_s_p90,evaluations_s_mean,master_busy_median,master_busy_p90,master_busy_mean\n");
+    fprintf(json, "{\"seeds\": %d, \"max_generations\": %ld, \"batch\": %d, \"configurations\": [", seeds, weaselGenerationLimit, BENCH_BATCH);
+    printf("%-15s %5s %7s %6s %7s %10s %10s %9s %9s %11s %6s\n", "variant", "ranks", "pool", "length", "solved", "gens med", "gens p90", "wall med", "wall p90", "evals/s med", "busy");
+  }
+
+  for(r=0;r<rankCount;++r) {
+    MPI_Comm_split(MPI_COMM_WORLD, rank < ranks[r] ? 0 : MPI_UNDEFINED, rank, &weaselComm);
+    for(l=0;l<lengthCount && weaselComm!=MPI_COMM_NULL;++l) {
+      char* target = randomTarget(lengths[l]);
+      targetStr = target;
+      initFitnessTables(&weaselTables, validChars, targetStr);
+      initGenomeLayout(&weaselGenome, &weaselTables, validChars, targetStr);
+      for(i=0;i<poolCount;++i) {
+        weaselPoolSize = pools[i];
+        for(v=0;v<VARIANTS;++v) {
+          weaselRun runs[seeds]; //Only filled in on the master
+          double measures[4][seeds];
+          benchSummary summaries[4];
+          int solved = 0;
+          if(!chosen[v])
+            continue;
+          for(s=0;s<seeds;++s) {
+            runVariant(&variants[v], rank, ranks[r], s + 1);
+            runs[s] = weaselLastRun;
+          }
+          if(rank != MASTER)
+            continue;
+          fprintf(json, "%s\n  {\"runs\": [", first ? "" : ",");
+          for(s=0;s<seeds;++s) {
+            measures[0][s] = runs[s].generations;
+            measures[1][s] = runs[s].seconds;
+            measures[2][s] = runs[s].evaluations / runs[s].seconds;
+            measures[3][s] = runs[s].busy / runs[s].seconds;
+            solved += runs[s].solved;
+            fprintf(json, "%s{\"seed\": %d, \"generations\": %ld, \"wall_s\": %f, \"evaluations\": %ld, \"master_busy\": %f, \"solved\": %s}", s ? ", " : "",
+              s + 1, runs[s].generations, runs[s].seconds, runs[s].evaluations, measures[3][s], runs[s].solved ? "true" : "false");
+          }
+          for(s=0;s<4;++s)
+            summaries[s] = summarise(measures[s], seeds);
+          fprintf(json, "], ");
+          printSummary(csv, json, &variants[v], ranks[r], lengths[l], seeds, solved, summaries);
+          fprintf(json, "}");
+          fflush(stdout);
+          first = 0;
+        }
+      }
+      freeGenomeLayout(&weaselGenome);
+      freeFitnessTables(&weaselTables);
+      free(target);
+    }
+    if(weaselComm != MPI_COMM_NULL)
+      MPI_Comm_free(&weaselComm);
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+
+  if(rank == MASTER) {
+    fprintf(json, "\n]}\n");
+    fclose(csv);
+    fclose(json);
+    printf("Results written to %s.csv and %s.json\n", prefix, prefix);
+  }
+  MPI_Finalize();
+  return 0;
+}
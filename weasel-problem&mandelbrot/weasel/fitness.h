@@ -0,0 +1,45 @@
+#ifndef FITNESS_H
+#define FITNESS_H
+
+//Fitness of candidate strings against the target, the negated sum over characters of the circular distance
+//between their positions in the alphabet. Lengths and the character to position table are worked out once,
+//so no string is scanned or measured while scoring. The GA itself scores packed genomes, see genome.h.
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  int validLen, targetLen; //Alphabet and target lengths, fixed for the run
+  unsigned char charIndex[256]; //Position of each character in the alphabet, validLen for characters outside it
+  unsigned char* target; //Target as alphabet positions
+} fitnessTables;
+
+
+void initFitnessTables(fitnessTables* tables, const char* validChars, const char* targetStr) {
+  int i;
+  tables->validLen = strlen(validChars);
+  tables->targetLen = strlen(targetStr);
+  memset(tables->charIndex, tables->validLen, sizeof(tables->charIndex));
+  for(i=tables->validLen-1;i>=0;--i) //Backwards so a repeated character keeps its first position, as a scan would
+    tables->charIndex[(unsigned char)validChars[i]] = i;
+  tables->target = malloc(tables->targetLen);
+  for(i=0;i<tables->targetLen;++i)
+    tables->target[i] = tables->charIndex[(unsigned char)targetStr[i]];
+}
+
+
+void freeFitnessTables(fitnessTables* tables) {
+  free(tables->target);
+}
+
+
+int stringFitness(const fitnessTables* tables, const char* candidate) { //Fitness of one string of characters
+  int i, difference, currentFitness = 0;
+  for(i=0;i<tables->targetLen;++i) {
+    difference = abs(tables->target[i] - tables->charIndex[(unsigned char)candidate[i]]);
+    currentFitness -= difference < tables->validLen - difference ? difference : tables->validLen - difference;
+  }
+  return currentFitness;
+}
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef GENOME_H
+#define GENOME_H
+
+//Packed genomes for targets and alphabets chosen at run time. A symbol is stored as its position in the alphabet
+//in the fewest bits that hold every position, 5 for the 27 character default, and as many symbols as fit
+//go into each 64 bit word without straddling into the next. A genome is a fixed number of words and a
+//pool is one cache aligned block of genomes back to back, so a pool of any size is a single heap
+//allocation and a genome goes into an MPI message as it is. Bits past the last symbol are always zero.
+//XOR of two words leaves some bit of a symbol set exactly where the symbols differ. Folding every
+//symbol's bits into its lowest bit and counting them gives the mismatches, so similarity is a popcount
+//per word and packedFitness only has to look at the symbols that differ from the target.
+//genomeFitness, which the GA uses, scores every symbol at once instead, and is quicker unless the genome is
+//a word or two long and nearly matches. Even and odd symbols are spread into lanes twice their width, and a
+//bit above each symbol lets a whole word of lanes be subtracted and compared without borrows, for the
+//difference, the shorter way round the alphabet and the running sum. With SSE2 it takes two words per step.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "fitness.h"
+#include "random.h"
+
+#define GENOME_POOL_ALIGN 64 //Pools start on a cache line
+#define DISPLAY_SYMBOLS 64 //Genomes printed are cut short after this many symbols
+
+typedef uint64_t genomeWord;
+
+typedef struct {
+  int symbols, alphabet; //Target length and alphabet size
+  int bits, perWord, words; //Bits per symbol, symbols per word and words per genome
+  genomeWord symbolMask; //One symbol's bits
+  genomeWord lowBits; //The lowest bit of every symbol in a word
+  genomeWord evenSymbols; //Bits of every other symbol from the first, each alone in a lane of twice its width
+  genomeWord laneGuard, laneAlphabet, laneHalf; //The bit above each lane's symbol, the alphabet size and half of it plus one
+  int lanes, laneWords; //Lanes per word, and words whose distances can be summed in the lanes before they overflow
+  const char* alphabetChars;
+  const unsigned char* charIndex; //Character to alphabet position, from the fitness tables
+  genomeWord* target;
+  unsigned char* distance; //Circular distance between two positions, target * alphabet + candidate
+} genomeLayout;
+
+
+genomeWord* allocGenomePool(const genomeLayout* layout, long count) { //Zeroed, cache aligned block of count genomes
+  size_t bytes = ((size_t)count * layout->words * sizeof(genomeWord) + GENOME_POOL_ALIGN - 1) / GENOME_POOL_ALIGN * GENOME_POOL_ALIGN;
+  void* pool;
+  if(posix_memalign(&pool, GENOME_POOL_ALIGN, bytes) != 0)
+    return NULL;
+  memset(pool, 0, bytes);
+  return pool;
+}
+
+
+static inline genomeWord* genomeAt(const genomeLayout* layout, genomeWord* pool, long index) {
+  return pool + (size_t)index * layout->words;
+}
+
+
+static inline int genomeSymbol(const genomeLayout* layout, const genomeWord* genome, int i) {
+  return (genome[i / layout->perWord] >> (i % layout->perWord * layout->bits)) & layout->symbolMask;
+}
+
+
+static inline void setGenomeSymbol(const genomeLayout* layout, genomeWord* genome, int i, int symbol) {
+  int shift = i % layout->perWord * layout->bits;
+  genome[i / layout->perWord] = (genome[i / layout->perWord] & ~(layout->symbolMask << shift)) | (genomeWord)symbol << shift;
+}
+
+
+static inline genomeWord mismatchBits(const genomeLayout* layout, genomeWord difference) { //Lowest bit of every symbol that differs
+  genomeWord folded = difference;
+  int b;
+  for(b=1;b<layout->bits;++b)
+    folded |= difference >> b;
+  return folded & layout->lowBits;
+}
+
+
+void encodeGenome(const genomeLayout* layout, const char* str, genomeWord* genome) { //str must only hold alphabet characters
+  int i;
+  memset(genome, 0, layout->words * sizeof(genomeWord));
+  for(i=0;i<layout->symbols;++i)
+    setGenomeSymbol(layout, genome, i, layout->charIndex[(unsigned char)str[i]]);
+}
+
+
+const char* genomeText(const genomeLayout* layout, const genomeWord* genome, char* text) { //text holds DISPLAY_SYMBOLS + 4
+  int i, shown = layout->symbols < DISPLAY_SYMBOLS ? layout->symbols : DISPLAY_SYMBOLS;
+  for(i=0;i<shown;++i)
+    text[i] = layout->alphabetChars[genomeSymbol(layout, genome, i)];
+  strcpy(text + shown, shown < layout->symbols ? "..." : "");
+  return text;
+}
+
+
+void initGenomeLayout(genomeLayout* layout, const fitnessTables* tables, const char* validChars, const char* targetStr) {
+  int a, b, top;
+  layout->symbols = tables->targetLen;
+  layout->alphabet = tables->validLen;
+  for(layout->bits=1;(1 << layout->bits) < layout->alphabet;++layout->bits);
+  layout->perWord = 64 / layout->bits;
+  layout->words = (layout->symbols + layout->perWord - 1) / layout->perWord;
+  layout->symbolMask = ((genomeWord)1 << layout->bits) - 1;
+  layout->lowBits = 0;
+  for(a=0;a<layout->perWord;++a)
+    layout->lowBits |= (genomeWord)1 << (a * layout->bits);
+  layout->lanes = (layout->perWord + 1) / 2;
+  top = 64 - 2 * (layout->lanes - 1) * layout->bits; //The last lane can be cut short by the end of the word
+  layout->laneWords = ((1 << (top < 2 * layout->bits ? top : 2 * layout->bits)) - 1) / layout->alphabet; //A word adds at most the alphabet size to a lane
+  layout->evenSymbols = layout->laneGuard = layout->laneAlphabet = layout->laneHalf = 0;
+  for(a=0;a<layout->lanes;++a) {
+    layout->evenSymbols |= layout->symbolMask << (2 * a * layout->bits);
+    layout->laneGuard |= (genomeWord)1 << ((2 * a + 1) * layout->bits);
+    layout->laneAlphabet |= (genomeWord)layout->alphabet << (2 * a * layout->bits);
+    layout->laneHalf |= (genomeWord)(layout->alphabet / 2 + 1) << (2 * a * layout->bits);
+  }
+  layout->alphabetChars = validChars;
+  layout->charIndex = tables->charIndex;
+  layout->distance = malloc(layout->alphabet * layout->alphabet);
+  for(a=0;a<layout->alphabet;++a)
+    for(b=0;b<layout->alphabet;++b) {
+      int difference = abs(a - b);
+      layout->distance[a * layout->alphabet + b] = difference < layout->alphabet - difference ? difference : layout->alphabet - difference;
+    }
+  layout->target = allocGenomePool(layout, 1);
+  encodeGenome(layout, targetStr, layout->target);
+}
+
+
+void freeGenomeLayout(genomeLayout* layout) {
+  free(layout->target);
+  free(layout->distance);
+}
+
+
+void randomGenome(const genomeLayout* layout, genomeWord* genome, rngState* rng) {
+  unsigned char draws[64];
+  int w, i, count;
+  for(w=0;w<layout->words;++w) { //One fill per word
+    count = layout->symbols - w * layout->perWord < layout->perWord ? layout->symbols - w * layout->perWord : layout->perWord;
+    rngFillBelow(rng, draws, count, layout->alphabet);
+    genome[w] = 0;
+    for(i=0;i<count;++i)
+      genome[w] |= (genomeWord)draws[i] << (i * layout->bits);
+  }
+}
+
+
+int packedFitness(const genomeLayout* layout, const genomeWord* genome) { //Negated sum of circular distances from the target
+  int w, bit, fitness = 0;
+  genomeWord mismatches, t, c;
+  for(w=0;w<layout->words;++w) {
+    t = layout->target[w];
+    c = genome[w];
+    for(mismatches=mismatchBits(layout, t ^ c);mismatches;mismatches&=mismatches-1) { //Only the symbols that differ
+      bit = __builtin_ctzll(mismatches);
+      fitness -= layout->distance[((t >> bit) & layout->symbolMask) * layout->alphabet + ((c >> bit) & layout->symbolMask)];
+    }
+  }
+  return fitness;
+}
+
+
+static inline genomeWord laneDistance(const genomeLayout* layout, genomeWord t, genomeWord c) { //t and c hold a symbol in each lane
+  genomeWord ahead = (t | layout->laneGuard) - c, behind = (c | layout->laneGuard) - t, keep, over;
+  keep = ahead & layout->laneGuard; //Lanes where t >= c, widened to the symbol's bits
+  keep -= keep >> layout->bits;
+  ahead = (ahead & keep) | (behind & ~keep & layout->evenSymbols); //|t - c|
+  over = ((ahead | layout->laneGuard) - layout->laneHalf) & layout->laneGuard; //Lanes past half the alphabet go the other way round
+  over -= over >> layout->bits;
+  return (ahead & ~over) | ((layout->laneAlphabet - ahead) & over);
+}
+
+
+static inline genomeWord wordDistance(const genomeLayout* layout, genomeWord t, genomeWord c) { //Even and odd symbols' distances summed per lane
+  return laneDistance(layout, t & layout->evenSymbols, c & layout->evenSymbols)
+       + laneDistance(layout, (t >> layout->bits) & layout->evenSymbols, (c >> layout->bits) & layout->evenSymbols);
+}
+
+
+static inline int laneSum(const genomeLayout* layout, genomeWord lanes) {
+  genomeWord laneMask = ((genomeWord)1 << 2 * layout->bits) - 1;
+  int sum = 0;
+  for(;lanes;lanes>>=2*layout->bits)
+    sum += lanes & laneMask;
+  return sum;
+}
+
+
+#ifdef __SSE2__
+static inline __m128i laneDistance2(const genomeLayout* layout, __m128i t, __m128i c) { //laneDistance on two words
+  __m128i guard = _mm_set1_epi64x(layout->laneGuard), even = _mm_set1_epi64x(layout->evenSymbols), bits = _mm_cvtsi32_si128(layout->bits);
+  __m128i ahead = _mm_sub_epi64(_mm_or_si128(t, guard), c), behind = _mm_sub_epi64(_mm_or_si128(c, guard), t), keep, over;
+  keep = _mm_and_si128(ahead, guard);
+  keep = _mm_sub_epi64(keep, _mm_srl_epi64(keep, bits));
+  ahead = _mm_or_si128(_mm_and_si128(ahead, keep), _mm_andnot_si128(keep, _mm_and_si128(behind, even)));
+  over = _mm_and_si128(_mm_sub_epi64(_mm_or_si128(ahead, guard), _mm_set1_epi64x(layout->laneHalf)), guard);
+  over = _mm_sub_epi64(over, _mm_srl_epi64(over, bits));
+  return _mm_or_si128(_mm_andnot_si128(over, ahead), _mm_and_si128(_mm_sub_epi64(_mm_set1_epi64x(layout->laneAlphabet), ahead), over));
+}
+#endif
+
+
+int genomeFitness(const genomeLayout* layout, const genomeWord* genome) { //Same as packedFitness, without looking for the mismatches
+  genomeWord lanes = 0;
+  int w = 0, fill = 0, fitness = 0;
+#ifdef __SSE2__
+  __m128i even = _mm_set1_epi64x(layout->evenSymbols), bits = _mm_cvtsi32_si128(layout->bits), sum = _mm_setzero_si128();
+  genomeWord halves[2];
+  for(;w+1<layout->words;w+=2) {
+    __m128i t = _mm_load_si128((const __m128i*)(layout->target + w)), c = _mm_loadu_si128((const __m128i*)(genome + w));
+    sum = _mm_add_epi64(sum, laneDistance2(layout, _mm_and_si128(t, even), _mm_and_si128(c, even)));
+    sum = _mm_add_epi64(sum, laneDistance2(layout, _mm_and_si128(_mm_srl_epi64(t, bits), even), _mm_and_si128(_mm_srl_epi64(c, bits), even)));
+    if(++fill == layout->laneWords || w + 3 >= layout->words) { //Empty the lanes before they overflow and at the end
+      _mm_storeu_si128((__m128i*)halves, sum);
+      fitness -= laneSum(layout, halves[0]) + laneSum(layout, halves[1]);
+      sum = _mm_setzero_si128();
+      fill = 0;
+    }
+  }
+#endif
+  for(;w<layout->words;++w) {
+    lanes += wordDistance(layout, layout->target[w], genome[w]);
+    if(++fill == layout->laneWords || w + 1 == layout->words) {
+      fitness -= laneSum(layout, lanes);
+      lanes = 0;
+      fill = 0;
+    }
+  }
+  return fitness;
+}
+
+
+void batchFitness(const genomeLayout* layout, const genomeWord* pool, long count, int* fitnesses) { //Fitness of count genomes back to back
+  long i;
+  for(i=0;i<count;++i)
+    fitnesses[i] = genomeFitness(layout, pool + (size_t)i * layout->words);
+}
+
+
+int genomeSimilarity(const genomeLayout* layout, const genomeWord* a, const genomeWord* b) { //Symbols that match
+  int w, similarity = layout->symbols;
+  for(w=0;w<layout->words;++w)
+    similarity -= __builtin_popcountll(mismatchBits(layout, a[w] ^ b[w]));
+  return similarity;
+}
+
+
+void crossOverAt(const genomeLayout* layout, genomeWord* a, genomeWord* b, int split) { //Swaps every symbol from split on
+  int w = split / layout->perWord;
+  genomeWord swap;
+  if(w >= layout->words)
+    return;
+  swap = (a[w] ^ b[w]) & (~(genomeWord)0 << (split % layout->perWord * layout->bits)); //The split word's upper symbols
+  a[w] ^= swap;
+  b[w] ^= swap;
+  for(++w;w<layout->words;++w) {
+    swap = a[w];
+    a[w] = b[w];
+    b[w] = swap;
+  }
+}
+
+
+void mutateSymbols(const genomeLayout* layout, genomeWord* genome, int ratePercent, rngState* rng) { //Each symbol is replaced with chance ratePercent
+  unsigned char rolls[256];
+  int i, j, count;
+  for(i=0;i<layout->symbols;i+=count) {
+    count = layout->symbols - i < (int)sizeof(rolls) ? layout->symbols - i : (int)sizeof(rolls);
+    rngFillBelow(rng, rolls, count, 100);
+    for(j=0;j<count;++j)
+      if(rolls[j] < ratePercent)
+        setGenomeSymbol(layout, genome, i + j, rngBelow(rng, layout->alphabet));
+  }
+}
+
+
+void mutateSymbolsRate(const genomeLayout* layout, genomeWord* genome, double rate, rngState* rng) { //Any rate below 1, jumping straight to the next symbol that mutates
+  double logKeep = log(1 - rate);
+  long i = -1;
+  while(1) { //Gaps between mutations are geometric, so the cost follows the mutations rather than the length
+    i += 1 + (long)(log(((rngNext(rng) >> 11) + 1) * 0x1p-53) / logKeep);
+    if(i >= layout->symbols || i < 0)
+      break;
+    setGenomeSymbol(layout, genome, i, rngBelow(rng, layout->alphabet));
+  }
+}
+
+#endif
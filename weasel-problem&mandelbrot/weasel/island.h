@@ -0,0 +1,189 @@
+#ifndef ISLAND_H
+#define ISLAND_H
+
+//Island model: every rank evolves a full pool of its own with the same selection, crossover, mutation and
+//replacement the master and nodes use, so no rank waits on another. Every migrationInterval generations
+//an island sends copies of its best strings to a neighbour with MPI_Isend, and folds in whatever
+//strings have arrived using the normal replacement rule. Whether any island has found the target is
+//tracked by a chain of MPI_Iallreduce calls that overlap the evolution instead of a broadcast each generation.
+
+#define MIGRATION_TAG 3
+#define DEFAULT_MIGRATION_INTERVAL 20
+#define DEFAULT_MIGRANTS 5
+#define ISLAND_PAIRS 4 //Parent pairs bred per island generation
+
+#define TOPOLOGY_RING 0 //Send to the next rank
+#define TOPOLOGY_RANDOM 1 //Send to a random other rank each time
+
+typedef struct {
+  int migrationInterval; //Generations between migrations
+  int migrants; //Strings sent per migration
+  int topology;
+} islandConfig;
+
+
+void findBestIndices(int* poolFitness, int poolSize, int count, int* indices) { //Indices of the count fittest strings, fittest first
+  int i, j;
+  for(i=0;i<count;++i)
+    indices[i] = -1;
+  for(i=0;i<poolSize;++i) {
+    if(indices[count-1] >= 0 && poolFitness[i] <= poolFitness[indices[count-1]]) //Not among the best so far
+      continue;
+    for(j=count-1;j>0 && (indices[j-1] < 0 || poolFitness[i] > poolFitness[indices[j-1]]);--j) //Insertion sort into place
+      indices[j] = indices[j-1];
+    indices[j] = i;
+  }
+}
+
+
+void islandLogic(int rank, int size, const islandConfig* config) {
+  int i, generation = 1, bestFitIndex = 0, bestFitness = MAX_NEGATIVE, prevBest = MAX_NEGATIVE;
+  int found = 0, anyFound = 0, reducing = 0, flag, count, source;
+  int words = GENOMEWORDS, migrantWords = config->migrants * words;
+  int solved, sent = 0, *sentTo = calloc(size, sizeof(int)), *sentFrom = calloc(size, sizeof(int)), *receivedFrom = calloc(size, sizeof(int));
+  char text[DISPLAY_SYMBOLS + 4];
+  genomeWord* pool = allocGenomePool(&weaselGenome, POOLSIZE);
+  genomeWord* genomes = allocGenomePool(&weaselGenome, 2);
+  genomeWord* sendBuffer = allocGenomePool(&weaselGenome, config->migrants);
+  genomeWord* recvBuffer = allocGenomePool(&weaselGenome, config->migrants);
+  int* bestIndices = malloc(config->migrants * sizeof(int));
+  int* poolFitness = malloc(POOLSIZE * sizeof(int));
+  poolTree tree;
+  poolSelector selector;
+  operatorSchedule schedule;
+  MPI_Request sendRequest = MPI_REQUEST_NULL, recvRequest = MPI_REQUEST_NULL, foundRequest;
+  MPI_Status stat;
+  long evaluations = POOLSIZE;
+  FILE* bestStringsFile = rank == MASTER && !weaselQuiet ? fopen("strings.txt", "w") : NULL;
+  double time = MPI_Wtime(), waiting = 0, mark;
+
+  for(i=0;i<POOLSIZE;++i) //Initial generation of the island's pool
+    generateGenome(GENOME(pool, i));
+  getPoolFitness(pool, POOLSIZE, poolFitness);
+  initPoolTree(&tree, poolFitness, POOLSIZE);
+  initSelector(&selector, weaselSelection, weaselTournamentSize, poolFitness, POOLSIZE, ROULETTE_OFFSET);
+  initSchedule(&schedule, TARGETLEN);
+  if(size > 1)
+    MPI_Irecv(recvBuffer, migrantWords, MPI_UINT64_T, MPI_ANY_SOURCE, MIGRATION_TAG, weaselComm, &recvRequest);
+
+  while(1) {
+    for(i=0;i<ISLAND_PAIRS && !found;++i) { //Breed from a selected pair and offer both children to the pool
+      int child, parent1 = selectString(&selector), parent2 = selectString(&selector), childFitness[2];
+      memcpy(GENOME(genomes, 0), GENOME(pool, parent1), words * sizeof(genomeWord));
+      memcpy(GENOME(genomes, 1), GENOME(pool, parent2), words * sizeof(genomeWord));
+      if(weaselAdaptive)
+        breedAdaptive(&schedule, GENOME(genomes, 0), GENOME(genomes, 1), poolFitness[parent1] > poolFitness[parent2] ? poolFitness[parent1] : poolFitness[parent2], childFitness);
+      else {
+        crossOverGenomes(GENOME(genomes, 0), GENOME(genomes, 1)); //Single split crossover
+        mutateGenome(GENOME(genomes, 0)); //Random mutate
+        mutateGenome(GENOME(genomes, 1));
+        getPoolFitness(genomes, 2, childFitness);
+      }
+      for(child=0;child<2;++child)
+        insertGenome(pool, poolFitness, &tree, &selector, GENOME(genomes, child), childFitness[child]);
+      evaluations += weaselAdaptive ? 4 : 2;
+    }
+
+    if(recvRequest != MPI_REQUEST_NULL) { //Fold in migrants from other islands
+      MPI_Test(&recvRequest, &flag, &stat);
+      while(flag) {
+        MPI_Get_count(&stat, MPI_UINT64_T, &count);
+        ++receivedFrom[stat.MPI_SOURCE];
+        for(i=0;i<count/words;++i)
+          insertGenome(pool, poolFitness, &tree, &selector, GENOME(recvBuffer, i), getFitness(GENOME(recvBuffer, i)));
+        evaluations += count / words;
+        MPI_Irecv(recvBuffer, migrantWords, MPI_UINT64_T, MPI_ANY_SOURCE, MIGRATION_TAG, weaselComm, &recvRequest);
+        MPI_Test(&recvRequest, &flag, &stat);
+      }
+    }
+
+    bestFitIndex = bestPoolIndex(&tree);
+    bestFitness = poolFitness[bestFitIndex];
+    if(bestFitness == 0 && !found) {
+      if(!weaselQuiet) {
+        printf("Island %d found the target string in %d generations!\n", rank, generation);
+        printf("Target string: %s\n", genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text));
+      }
+      if(bestStringsFile)
+        fprintf(bestStringsFile, "[%d]\t%s\n", generation, text);
+      found = 1;
+    }
+    else if(rank == MASTER && prevBest != bestFitness && !weaselQuiet) { //Progress of the master's own island
+      prevBest = bestFitness;
+      printf("[%d]\t%s %d\n", generation, genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text), bestFitness);
+      fprintf(bestStringsFile, "[%d]\t%s\n", generation, text);
+    }
+    if(weaselGenerationLimit && generation >= weaselGenerationLimit) //Every island gives up at the same generation
+      found = 1;
+
+    if(size > 1 && generation % config->migrationInterval == 0) { //Send copies of the best strings on, unless the last batch is still in flight
+      MPI_Test(&sendRequest, &flag, MPI_STATUS_IGNORE);
+      if(flag) {
+        int dest = config->topology == TOPOLOGY_RING ? (rank + 1) % size : (rank + 1 + (int)rngBelow(&weaselRandom, size - 1)) % size;
+        findBestIndices(poolFitness, POOLSIZE, config->migrants, bestIndices);
+        for(i=0;i<config->migrants;++i)
+          memcpy(GENOME(sendBuffer, i), GENOME(pool, bestIndices[i]), words * sizeof(genomeWord));
+        MPI_Isend(sendBuffer, migrantWords, MPI_UINT64_T, dest, MIGRATION_TAG, weaselComm, &sendRequest);
+        ++sentTo[dest];
+        ++sent;
+      }
+    }
+
+    if(!reducing) { //Ask whether anyone has found it, the answer arrives while evolution carries on
+      anyFound = found;
+      MPI_Iallreduce(MPI_IN_PLACE, &anyFound, 1, MPI_INT, MPI_MAX, weaselComm, &foundRequest);
+      reducing = 1;
+    }
+    MPI_Test(&foundRequest, &flag, MPI_STATUS_IGNORE);
+    if(flag) {
+      reducing = 0;
+      if(anyFound)
+        break;
+    }
+    ++generation;
+  }
+
+  mark = MPI_Wtime();
+  if(size > 1) { //Receive every migration still in flight so no send is left unmatched
+    MPI_Wait(&sendRequest, MPI_STATUS_IGNORE);
+    MPI_Alltoall(sentTo, 1, MPI_INT, sentFrom, 1, MPI_INT, weaselComm);
+    for(source=0;source<size;++source)
+      while(receivedFrom[source] < sentFrom[source]) {
+        MPI_Wait(&recvRequest, &stat);
+        ++receivedFrom[stat.MPI_SOURCE];
+        MPI_Irecv(recvBuffer, migrantWords, MPI_UINT64_T, MPI_ANY_SOURCE, MIGRATION_TAG, weaselComm, &recvRequest);
+      }
+    MPI_Cancel(&recvRequest);
+    MPI_Wait(&recvRequest, MPI_STATUS_IGNORE);
+  }
+
+  solved = bestFitness == 0;
+  MPI_Reduce(rank == MASTER ? MPI_IN_PLACE : &sent, &sent, 1, MPI_INT, MPI_SUM, MASTER, weaselComm);
+  MPI_Reduce(rank == MASTER ? MPI_IN_PLACE : &evaluations, &evaluations, 1, MPI_LONG, MPI_SUM, MASTER, weaselComm);
+  MPI_Reduce(rank == MASTER ? MPI_IN_PLACE : &solved, &solved, 1, MPI_INT, MPI_MAX, MASTER, weaselComm);
+  waiting += MPI_Wtime() - mark; //Islands have no master, this is the master's island waiting for the rest to stop
+  if(rank == MASTER) {
+    time = MPI_Wtime() - time;
+    weaselLastRun = (weaselRun){generation, evaluations, time, time - waiting, solved};
+  }
+  if(rank == MASTER && !weaselQuiet) {
+    printf("Islands stopped after %d generations on the master's island in %f seconds, %d migrations of %d strings\n", generation, time, sent, config->migrants);
+    printf("%ld fitness evaluations, %.0f/s\n", evaluations, evaluations / time);
+    if(weaselAdaptive)
+      printSchedule(&schedule, "Master's island");
+    fclose(bestStringsFile);
+  }
+  free(sentTo);
+  free(sentFrom);
+  free(receivedFrom);
+  free(sendBuffer);
+  free(recvBuffer);
+  free(genomes);
+  free(bestIndices);
+  freePoolTree(&tree);
+  freeSelector(&selector);
+  free(pool);
+  free(poolFitness);
+}
+
+#endif
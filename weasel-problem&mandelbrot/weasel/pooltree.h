@@ -0,0 +1,76 @@
+#ifndef POOLTREE_H
+#define POOLTREE_H
+
+//Tournament trees over the pool's fitnesses, one keeping the least fit string and one the fittest, so
+//neither has to be found by scanning the whole pool. Each leaf is a pool index and each inner node holds
+//the winner of its two children, so after a string is replaced only the matches on the path from its
+//leaf to the root are replayed, O(log n). Ties go to the lower index, the same string a scan from the
+//start of the pool finds first.
+
+#include <stdlib.h>
+
+typedef struct {
+  int count, leaves; //Pool size, and that rounded up to a power of two
+  const int* fitness; //The pool's fitnesses, read when matches are replayed
+  int* worst; //Trees of pool indices, root at 1 and leaf i at leaves + i, -1 where there is no string
+  int* best;
+} poolTree;
+
+
+int worseString(const poolTree* tree, int a, int b) { //Loser of a match for the worst tree
+  if(b < 0)
+    return a;
+  if(a < 0)
+    return b;
+  return tree->fitness[b] < tree->fitness[a] ? b : a;
+}
+
+int betterString(const poolTree* tree, int a, int b) {
+  if(b < 0)
+    return a;
+  if(a < 0)
+    return b;
+  return tree->fitness[b] > tree->fitness[a] ? b : a;
+}
+
+
+void initPoolTree(poolTree* tree, const int* fitness, int count) { //Builds both trees bottom up in O(n)
+  int i;
+  tree->count = count;
+  tree->fitness = fitness;
+  for(tree->leaves=1;tree->leaves<count;tree->leaves*=2);
+  tree->worst = malloc(2 * tree->leaves * sizeof(int));
+  tree->best = malloc(2 * tree->leaves * sizeof(int));
+  for(i=0;i<tree->leaves;++i)
+    tree->worst[tree->leaves + i] = tree->best[tree->leaves + i] = i < count ? i : -1;
+  for(i=tree->leaves-1;i>0;--i) {
+    tree->worst[i] = worseString(tree, tree->worst[2*i], tree->worst[2*i+1]);
+    tree->best[i] = betterString(tree, tree->best[2*i], tree->best[2*i+1]);
+  }
+}
+
+
+void freePoolTree(poolTree* tree) {
+  free(tree->worst);
+  free(tree->best);
+}
+
+
+void updatePoolTree(poolTree* tree, int index) { //Call after fitness[index] changes
+  int i;
+  for(i=(tree->leaves+index)/2;i>0;i/=2) {
+    tree->worst[i] = worseString(tree, tree->worst[2*i], tree->worst[2*i+1]);
+    tree->best[i] = betterString(tree, tree->best[2*i], tree->best[2*i+1]);
+  }
+}
+
+
+int worstPoolIndex(const poolTree* tree) { //Index of the least fit string in the pool
+  return tree->worst[1];
+}
+
+int bestPoolIndex(const poolTree* tree) { //Index of the fittest string in the pool
+  return tree->best[1];
+}
+
+#endif
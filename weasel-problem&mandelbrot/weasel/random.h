@@ -0,0 +1,89 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+//Random numbers for the GA, xoshiro256** in place of rand. The state is thread local, so each thread draws from
+//its own stream without locking. Streams come from one seed: splitmix64 expands it into a state, the
+//long jump (2^192 draws) is taken once per rank and the jump (2^128 draws) once per thread, so no two
+//streams overlap however many ranks and threads there are. Bounded draws use the top bits, which are the
+//strongest, by multiplying rather than with a modulo. Everything goes through rngNext, so another
+//generator only has to replace rngNext, rngJumpBy and rngSeed.
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t s[4];
+} rngState;
+
+_Thread_local rngState weaselRandom; //Seeded by rngSeed before any other use, an all zero state only gives zeros
+
+
+static inline uint64_t rngRotate(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+
+static inline uint64_t rngNext(rngState* rng) { //xoshiro256** by Blackman and Vigna
+  uint64_t result = rngRotate(rng->s[1] * 5, 7) * 9, t = rng->s[1] << 17;
+  rng->s[2] ^= rng->s[0];
+  rng->s[3] ^= rng->s[1];
+  rng->s[1] ^= rng->s[2];
+  rng->s[0] ^= rng->s[3];
+  rng->s[2] ^= t;
+  rng->s[3] = rngRotate(rng->s[3], 45);
+  return result;
+}
+
+
+static inline uint32_t rngBelow(rngState* rng, uint32_t n) { //Uniform in [0, n)
+  return (uint32_t)(((rngNext(rng) >> 32) * n) >> 32);
+}
+
+
+static inline uint64_t rngBelow64(rngState* rng, uint64_t n) { //Bias of at most n / 2^64
+  return rngNext(rng) % n;
+}
+
+
+static void rngJumpBy(rngState* rng, const uint64_t* jump) { //Advances as far as the jump polynomial says
+  uint64_t s[4] = {0, 0, 0, 0};
+  int i, b, j;
+  for(i=0;i<4;++i)
+    for(b=0;b<64;++b) {
+      if(jump[i] & (uint64_t)1 << b)
+        for(j=0;j<4;++j)
+          s[j] ^= rng->s[j];
+      rngNext(rng);
+    }
+  for(j=0;j<4;++j)
+    rng->s[j] = s[j];
+}
+
+
+static void rngSeed(rngState* rng, uint64_t seed, int rank, int thread) { //Stream for one thread of one rank
+  static const uint64_t jump[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+  static const uint64_t longJump[4] = {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+  int i;
+  for(i=0;i<4;++i) { //splitmix64, so nearby seeds still give unrelated states
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    rng->s[i] = z ^ (z >> 31);
+  }
+  for(i=0;i<rank;++i)
+    rngJumpBy(rng, longJump);
+  for(i=0;i<thread;++i)
+    rngJumpBy(rng, jump);
+}
+
+
+static void rngFillBelow(rngState* rng, unsigned char* out, int count, int bound) { //count draws in [0, bound), bound at most 256
+  int i, j;
+  uint64_t bits;
+  for(i=0;i<count;i+=4) { //Four 16 bit draws from each 64 bit output
+    bits = rngNext(rng);
+    for(j=0;j<4 && i+j<count;++j, bits>>=16)
+      out[i+j] = (unsigned char)(((bits & 0xffff) * bound) >> 16);
+  }
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+//Parent selection strategies, picked at run time with -selection:
+//  biased      the original scheme, the best of every string's fitness plus noise, O(n) draws
+//  roulette    fitness proportional, a Fenwick tree of weights kept up to date as strings are replaced, O(log n)
+//  tournament  the fittest of k strings drawn at random, O(k)
+//Roulette weights are fitness shifted up by the worst fitness a string can have, plus one, so every string
+//keeps a chance of being picked.
+
+#include <stdlib.h>
+#include <string.h>
+#include "random.h"
+
+#define SELECTION_BIASED 0
+#define SELECTION_ROULETTE 1
+#define SELECTION_TOURNAMENT 2
+#define DEFAULT_TOURNAMENT_SIZE 3
+
+typedef struct {
+  int strategy, tournamentSize;
+  int count; //Pool size
+  const int* fitness;
+  long long* fenwick; //Roulette only, 1 based partial sums of the weights
+  long long weightOffset; //Added to a fitness to give its weight
+  int topStep; //Largest power of two no greater than count, where the Fenwick descent starts
+} poolSelector;
+
+
+int selectionStrategy(const char* name) { //-1 for an unknown name
+  if(strcmp(name, "biased") == 0)
+    return SELECTION_BIASED;
+  if(strcmp(name, "roulette") == 0)
+    return SELECTION_ROULETTE;
+  if(strcmp(name, "tournament") == 0)
+    return SELECTION_TOURNAMENT;
+  return -1;
+}
+
+
+void initSelector(poolSelector* selector, int strategy, int tournamentSize, const int* fitness, int count, long long weightOffset) {
+  int i, j;
+  selector->strategy = strategy;
+  selector->tournamentSize = tournamentSize;
+  selector->count = count;
+  selector->fitness = fitness;
+  selector->weightOffset = weightOffset;
+  selector->fenwick = NULL;
+  if(strategy != SELECTION_ROULETTE)
+    return;
+  selector->fenwick = calloc(count + 1, sizeof(long long));
+  for(i=1;i<=count;++i) { //Built in O(n) by pushing each partial sum up to its parent
+    selector->fenwick[i] += fitness[i-1] + weightOffset;
+    j = i + (i & -i);
+    if(j <= count)
+      selector->fenwick[j] += selector->fenwick[i];
+  }
+  for(selector->topStep=1;selector->topStep*2<=count;selector->topStep*=2);
+}
+
+
+void freeSelector(poolSelector* selector) {
+  free(selector->fenwick);
+}
+
+
+void updateSelector(poolSelector* selector, int index, int oldFitness) { //Call after fitness[index] changes
+  int i;
+  long long delta = selector->fitness[index] - oldFitness;
+  if(!selector->fenwick || delta == 0)
+    return;
+  for(i=index+1;i<=selector->count;i+=i&-i)
+    selector->fenwick[i] += delta;
+}
+
+
+int biasedSelection(const int* fitnesses, int count) { //Roulette selection implementation
+  int i, currentIndex = 0, selectionFitness = MAX_NEGATIVE;
+  for(i=0;i<count;++i) {
+    int random = 0.9 * fitnesses[i] - (int)rngBelow(&weaselRandom, 100);
+    if(random >= selectionFitness) { //Greater than or equal to to increase the chances an unfit string will be sent
+      currentIndex = i;
+      selectionFitness = random;
+    }
+  }
+  return currentIndex;
+}
+
+
+int rouletteSelection(const poolSelector* selector) { //Descends the Fenwick tree to the string whose weight covers the draw
+  int step, pos = 0;
+  long long total = 0, draw;
+  for(pos=selector->count;pos>0;pos-=pos&-pos) //Total weight
+    total += selector->fenwick[pos];
+  draw = rngBelow64(&weaselRandom, total);
+  for(step=selector->topStep;step>0;step/=2)
+    if(pos + step <= selector->count && selector->fenwick[pos + step] <= draw) {
+      pos += step;
+      draw -= selector->fenwick[pos];
+    }
+  return pos;
+}
+
+
+int tournamentSelection(const poolSelector* selector) {
+  int i, candidate, winner = rngBelow(&weaselRandom, selector->count);
+  for(i=1;i<selector->tournamentSize;++i) {
+    candidate = rngBelow(&weaselRandom, selector->count);
+    if(selector->fitness[candidate] > selector->fitness[winner])
+      winner = candidate;
+  }
+  return winner;
+}
+
+
+int selectString(const poolSelector* selector) { //Index of a parent chosen by the selector's strategy
+  switch(selector->strategy) {
+    case SELECTION_ROULETTE:
+      return rouletteSelection(selector);
+    case SELECTION_TOURNAMENT:
+      return tournamentSelection(selector);
+    default:
+      return biasedSelection(selector->fitness, selector->count);
+  }
+}
+
+#endif
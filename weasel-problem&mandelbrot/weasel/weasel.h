@@ -0,0 +1,435 @@
+#ifndef WEASEL_H
+#define WEASEL_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "mpi.h"
+#include "fitness.h"
+#include "genome.h"
+#include "pooltree.h"
+
+//Shared by weasel.c and bounded_weasel.c, which only differ in WEASEL_ACCEPT, the rule for letting a
+//string replace the worst one in the pool. Define it before including this file to change the rule,
+//DEFAULT_ACCEPT and BOUNDED_ACCEPT are the two rules the solvers use.
+//Strings are held as packed genomes, see genome.h, so the target and alphabet can be set at run time.
+
+#define MAX_NEGATIVE INT_MIN //Below any fitness, long targets can score well under -999999
+#define DEFAULT_POOLSIZE 1000
+#define POOLSIZE (weaselPoolSize) //Set with -pool, the pools live on the heap so this can reach millions
+#define VALIDLEN (weaselTables.validLen) //Measured once by initFitnessTables
+#define TARGETLEN (weaselTables.targetLen)
+#define GENOMEWORDS (weaselGenome.words) //Words per packed genome, also its MPI_UINT64_T count in messages
+#define GENOME(pool, i) genomeAt(&weaselGenome, (pool), (i))
+
+#define MUTATION_RATE 5
+#define DEFAULT_LOCAL_SIZE 256 //Genomes in each node's population with -threads
+#define ROULETTE_OFFSET (TARGETLEN * (VALIDLEN / 2) + 1) //Least fit string possible, every character as far off as it can be, gets weight 1
+
+#define FOUND_TAG 0
+#define MASTER_SEND_TAG 1
+#define MASTER_RECV_TAG 2
+#define MASTER 0
+
+#include "selection.h"
+
+//Fitter, or different enough from the string it replaces to keep the pool diverse
+#define DEFAULT_ACCEPT(strFit, worstFitness, diverse) ((strFit) > (worstFitness) || (diverse))
+//Only lets a string that passes the diversity check in when it is within 5 of the worst fitness in the pool
+#define BOUNDED_ACCEPT(strFit, worstFitness, diverse) ((strFit) > (worstFitness) || ((strFit) + 5 > (worstFitness) && (diverse)))
+#ifndef WEASEL_ACCEPT
+#define WEASEL_ACCEPT(strFit, worstFitness, diverse) DEFAULT_ACCEPT(strFit, worstFitness, diverse)
+#endif
+
+const char* validChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "; //Set with -alphabet
+const char* targetStr = "WEASEL"; //Set with -target, -targetfile or -randomtarget
+fitnessTables weaselTables;
+genomeLayout weaselGenome;
+int weaselPoolSize = DEFAULT_POOLSIZE;
+int weaselSelection = SELECTION_BIASED; //Set with -selection and -k
+int weaselTournamentSize = DEFAULT_TOURNAMENT_SIZE;
+int weaselBatch = 0; //Strings per node per round with -batch, 0 for a pair each in separate messages
+int weaselThreads = 0; //Threads evolving each node's own population with -threads, 0 to breed only the parents sent
+int weaselLocalSize = DEFAULT_LOCAL_SIZE;
+int weaselLocalGenerations = 1; //Local generations between exchanges with the master
+int weaselAdaptive = 0; //Operators and mutation rate scheduled per population with -adaptive, see adaptive.h
+unsigned long long weaselSeed; //Every rank and thread derives its random stream from this
+long weaselGenerationLimit = 0; //Runs stop here without the target with -maxgens, 0 for no limit
+int weaselQuiet = 0; //No progress lines, summaries or strings.txt, for bench_weasel
+MPI_Comm weaselComm; //The solvers' ranks, MPI_COMM_WORLD unless bench_weasel runs them on a sub-communicator
+
+typedef struct { //What rank 0 of the last run measured
+  long generations; //Iterations, offspring batches or island generations, depending on the mode
+  long evaluations; //Over every rank
+  double seconds, busy; //Wall time, and the part of it the master spent outside calls waiting on nodes
+  int solved;
+} weaselRun;
+
+weaselRun weaselLastRun;
+
+int min(int a, int b) {
+  return a < b ? a : b;
+}
+
+
+int getFitness(const genomeWord* candidate) { //Returns the fitness of the passed genome with regard to the target string
+  return genomeFitness(&weaselGenome, candidate);
+}
+
+
+void getPoolFitness(const genomeWord* genomes, int count, int* fitnesses) { //Fitness of count genomes back to back
+  batchFitness(&weaselGenome, genomes, count, fitnesses);
+}
+
+
+void generateGenome(genomeWord* genome) {
+  randomGenome(&weaselGenome, genome, &weaselRandom);
+}
+
+
+void insertGenome(genomeWord* pool, int* poolFitness, poolTree* tree, poolSelector* selector, const genomeWord* genome, int strFit) {
+  int worstFitIndex = worstPoolIndex(tree), worstFitness = poolFitness[worstFitIndex];
+  //If the current genome being looked at is fitter or passes a diversity check
+  if(WEASEL_ACCEPT(strFit, worstFitness, genomeSimilarity(&weaselGenome, GENOME(pool, worstFitIndex), genome) < TARGETLEN/2+1)) {
+    memcpy(GENOME(pool, worstFitIndex), genome, GENOMEWORDS * sizeof(genomeWord)); //Add the genome into the pool
+    poolFitness[worstFitIndex] = strFit; //Change the string fitness to match
+    updatePoolTree(tree, worstFitIndex); //Replay its matches so the next least fit string is at the root
+    updateSelector(selector, worstFitIndex, worstFitness);
+  }
+}
+
+
+void masterLogic(int size) {
+  int i, nodes = size - 1, iteration = 1, bestFitIndex = 0, bestFitness = MAX_NEGATIVE, found = 0, prevBest = MAX_NEGATIVE;
+  int perNode = weaselBatch ? weaselBatch : 2, received = nodes * perNode, words = GENOMEWORDS;
+  long messages = 0, evaluations;
+  char text[DISPLAY_SYMBOLS + 4];
+  genomeWord* pool = allocGenomePool(&weaselGenome, POOLSIZE);
+  genomeWord* recvPool = allocGenomePool(&weaselGenome, received);
+  genomeWord* sendPool = allocGenomePool(&weaselGenome, received); //Parents for every node, packed in rank order
+  int* counts = calloc(size, sizeof(int)), *displs = calloc(size, sizeof(int));
+  int* poolFitness = malloc(POOLSIZE * sizeof(int)), *recvFitness = malloc(received * sizeof(int));
+  poolTree tree;
+  poolSelector selector;
+  MPI_Status stat;
+  FILE* bestStringsFile = weaselQuiet ? NULL : fopen("strings.txt", "w");
+  double time = MPI_Wtime(), waiting = 0, mark;
+
+  for(i=1;i<size;++i) { //Each node's share of the batch buffers, the master's own share is empty
+    counts[i] = perNode * words;
+    displs[i] = (i - 1) * perNode * words;
+  }
+
+  for(i=0;i<POOLSIZE;++i) //Initial generation of the pool
+    generateGenome(GENOME(pool, i));
+  getPoolFitness(pool, POOLSIZE, poolFitness);
+  initPoolTree(&tree, poolFitness, POOLSIZE);
+  initSelector(&selector, weaselSelection, weaselTournamentSize, poolFitness, POOLSIZE, ROULETTE_OFFSET);
+  bestFitness = poolFitness[bestPoolIndex(&tree)];
+
+  if(bestFitness==0) //Optimistically the solution is randomly generated
+    found = 1;
+
+  while(1) {
+    mark = MPI_Wtime();
+    MPI_Bcast(&found, 1, MPI_INT, 0, weaselComm);
+    if(found==1) break;
+
+    if(weaselBatch) //Every node's offspring in one gather
+      MPI_Gatherv(NULL, 0, MPI_UINT64_T, recvPool, counts, displs, MPI_UINT64_T, MASTER, weaselComm);
+    else
+      for(i=0;i<nodes*2;++i)
+        MPI_Recv(GENOME(recvPool, i), words, MPI_UINT64_T, MPI_ANY_SOURCE, MASTER_RECV_TAG, weaselComm, &stat); //Recv every string pair from the nodes
+    waiting += MPI_Wtime() - mark;
+
+    for(i=0;i<received;++i) //New parents for every node with the chosen selection
+      memcpy(GENOME(sendPool, i), GENOME(pool, selectString(&selector)), words * sizeof(genomeWord));
+    mark = MPI_Wtime();
+    if(weaselBatch) { //Then all their parents in one scatter
+      MPI_Scatterv(sendPool, counts, displs, MPI_UINT64_T, NULL, 0, MPI_UINT64_T, MASTER, weaselComm);
+      messages += 2 * nodes;
+    }
+    else {
+      for(i=1;i<size;++i) { //Send each node its new pair of strings to operate on
+        MPI_Send(GENOME(sendPool, (i - 1) * 2), words, MPI_UINT64_T, i, MASTER_SEND_TAG, weaselComm);
+        MPI_Send(GENOME(sendPool, (i - 1) * 2 + 1), words, MPI_UINT64_T, i, MASTER_SEND_TAG, weaselComm);
+      }
+      messages += 4 * nodes;
+    }
+    waiting += MPI_Wtime() - mark;
+
+    getPoolFitness(recvPool, received, recvFitness); //Score every string received before any goes in
+    for(i=0;i<received;++i)
+      insertGenome(pool, poolFitness, &tree, &selector, GENOME(recvPool, i), recvFitness[i]);
+    bestFitIndex = bestPoolIndex(&tree); //Re-find the best fit string
+    bestFitness = poolFitness[bestFitIndex];
+
+    if(bestFitness == 0) {
+      if(!weaselQuiet) {
+        printf("Target string found in %d iterations!\n", iteration);
+        printf("Target string: %s\n", genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text));
+        fprintf(bestStringsFile, "[%d]\t%s\n", iteration, text);
+      }
+      found = 1;
+    }
+    else if(prevBest != bestFitness) {
+      prevBest = bestFitness;
+      if(!weaselQuiet) {
+        printf("[%d]\t%s %d\n", iteration, genomeText(&weaselGenome, GENOME(pool, bestFitIndex), text), bestFitness);
+        fprintf(bestStringsFile, "[%d]\t%s\n", iteration, text);
+      }
+    }
+    if(weaselGenerationLimit && iteration >= weaselGenerationLimit) //Give up, the nodes stop the same way
+      found = 1;
+    ++iteration;
+  }
+  waiting += MPI_Wtime() - mark; //The final broadcast
+  evaluations = POOLSIZE + (long)(iteration - 1) * received;
+  MPI_Reduce(MPI_IN_PLACE, &evaluations, 1, MPI_LONG, MPI_SUM, MASTER, weaselComm); //The nodes' own evaluations, if they have populations
+  time = MPI_Wtime() - time;
+  weaselLastRun = (weaselRun){iteration - 1, evaluations, time, time - waiting, bestFitness == 0};
+  if(!weaselQuiet) {
+    printf("%d iterations in %f seconds, %.0f iterations/s, %.0f messages/s and %.0f strings/s each way, %d strings per message\n",
+      iteration - 1, time, (iteration - 1) / time, messages / time, (double)(iteration - 1) * received / time, weaselBatch ? weaselBatch : 1);
+    printf("%ld fitness evaluations, %.0f/s, master busy %.0f%% of the time\n", evaluations, evaluations / time, 100 * (time - waiting) / time);
+    fclose(bestStringsFile);
+  }
+  freePoolTree(&tree);
+  freeSelector(&selector);
+  free(pool);
+  free(recvPool);
+  free(sendPool);
+  free(counts);
+  free(displs);
+  free(poolFitness);
+  free(recvFitness);
+}
+
+
+void crossOverGenomes(genomeWord* genome1, genomeWord* genome2) {
+  int split = (TARGETLEN/2) + (rngBelow(&weaselRandom, TARGETLEN/4)+1); //Split in the middle of the string plus or minus a quarter of the entire string length
+  crossOverAt(&weaselGenome, genome1, genome2, split);
+}
+
+
+void mutateGenome(genomeWord* genome) { //Every symbol mutates to a random one with chance MUTATION_RATE percent
+  mutateSymbols(&weaselGenome, genome, MUTATION_RATE, &weaselRandom);
+}
+
+
+void breedGenomes(genomeWord* genomes, int count, int mode) { //Every pair gets the same operator
+  int i;
+  for(i=0;i<count;i+=2) {
+    if(mode == 0)
+      crossOverGenomes(GENOME(genomes, i), GENOME(genomes, i+1)); //Single split crossover
+    else {
+      mutateGenome(GENOME(genomes, i)); //Random mutate
+      mutateGenome(GENOME(genomes, i+1));
+    }
+  }
+}
+
+
+#include "adaptive.h"
+#include "island.h"
+#include "workers.h"
+
+
+void nodeLogic(int rank) {
+  int i, mode = (rank % 2 == 0 ? 0 : 1), found = 0, count = weaselBatch ? weaselBatch : 2, words = GENOMEWORDS;
+  long evaluations = 0;
+  genomeWord* genomes = allocGenomePool(&weaselGenome, count); //A pair, or the whole batch packed back to back
+  localPopulation local;
+  operatorSchedule schedule;
+
+  initSchedule(&schedule, TARGETLEN);
+  if(weaselThreads)
+    initLocalPopulation(&local, weaselLocalSize, weaselThreads, weaselLocalGenerations, rank);
+
+  for(i=0;i<count;++i)
+    generateGenome(GENOME(genomes, i)); //Generate random strings to start from
+  
+  while(1) {
+    MPI_Bcast(&found, 1, MPI_INT, 0, weaselComm);
+    if(found==1) break;
+
+    if(weaselBatch) { //Offspring up in one message, parents back in one message
+      MPI_Gatherv(genomes, count * words, MPI_UINT64_T, NULL, NULL, NULL, MPI_UINT64_T, MASTER, weaselComm);
+      MPI_Scatterv(NULL, NULL, NULL, MPI_UINT64_T, genomes, count * words, MPI_UINT64_T, MASTER, weaselComm);
+    }
+    else {
+      for(i=0;i<2;++i)
+        MPI_Send(GENOME(genomes, i), words, MPI_UINT64_T, MASTER, MASTER_RECV_TAG, weaselComm); //Send string pair to master node
+      for(i=0;i<2;++i)
+        MPI_Recv(GENOME(genomes, i), words, MPI_UINT64_T, MASTER, MASTER_SEND_TAG, weaselComm, MPI_STATUS_IGNORE); //Recv new string pair
+    }
+    
+    if(weaselThreads) //The local population takes the parents in and the fittest go back
+      evolveLocal(&local, genomes, count);
+    else if(weaselAdaptive) {
+      breedGenomesAdaptive(&schedule, genomes, count);
+      evaluations += 2 * count; //Parents and children are scored to reward the operator
+    }
+    else
+      breedGenomes(genomes, count, mode);
+    mode = !mode;
+  }
+  if(weaselThreads) {
+    evaluations = localEvaluations(&local);
+    freeLocalPopulation(&local);
+  }
+  MPI_Reduce(&evaluations, NULL, 1, MPI_LONG, MPI_SUM, MASTER, weaselComm);
+  free(genomes);
+}
+
+
+#include "async.h"
+
+
+char* buildTarget(const char* targetFile, int randomLength, unsigned long long seed, int size) { //The master's target, NULL if it can't be read
+  char* target = NULL;
+  long length;
+  int i;
+  if(targetFile) { //Whole file, less trailing line breaks
+    FILE* file = fopen(targetFile, "rb");
+    if(!file)
+      return NULL;
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    target = malloc(length + 1);
+    length = fread(target, 1, length, file);
+    fclose(file);
+    while(length > 0 && (target[length-1] == '\n' || target[length-1] == '\r'))
+      --length;
+    target[length] = '\0';
+  }
+  else if(randomLength > 0) { //From a stream none of the ranks use
+    rngState rng;
+    rngSeed(&rng, seed, size, 0);
+    target = malloc(randomLength + 1);
+    for(i=0;i<randomLength;++i)
+      target[i] = validChars[rngBelow(&rng, strlen(validChars))];
+    target[randomLength] = '\0';
+  }
+  else
+    target = strdup(targetStr);
+  return target;
+}
+
+
+int weaselMain(int argc, char** argv) {
+  int i, rank, worldSz, provided, island = 0, async = 0, seeded = 0, randomLength = 0, targetLength = 0;
+  unsigned long long seed = 0;
+  const char* targetFile = NULL;
+  char* target = NULL;
+  islandConfig config = {DEFAULT_MIGRATION_INTERVAL, DEFAULT_MIGRANTS, TOPOLOGY_RING};
+
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); //With -threads only the main thread talks to other ranks
+  MPI_Comm_size(MPI_COMM_WORLD, &worldSz);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  weaselComm = MPI_COMM_WORLD;
+
+  for(i=1;i<argc;++i) {
+    if(strcmp(argv[i], "-island") == 0)
+      island = 1;
+    else if(strcmp(argv[i], "-async") == 0)
+      async = 1;
+    else if(strcmp(argv[i], "-adaptive") == 0)
+      weaselAdaptive = 1;
+    else if((strcmp(argv[i], "--seed") == 0 || strcmp(argv[i], "-seed") == 0) && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+      seeded = 1;
+    }
+    else if(strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+      targetStr = argv[++i];
+    else if(strcmp(argv[i], "-targetfile") == 0 && i + 1 < argc)
+      targetFile = argv[++i];
+    else if(strcmp(argv[i], "-randomtarget") == 0 && i + 1 < argc)
+      randomLength = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-alphabet") == 0 && i + 1 < argc)
+      validChars = argv[++i];
+    else if(strcmp(argv[i], "-pool") == 0 && i + 1 < argc)
+      weaselPoolSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-selection") == 0 && i + 1 < argc && selectionStrategy(argv[i+1]) >= 0)
+      weaselSelection = selectionStrategy(argv[++i]);
+    else if(strcmp(argv[i], "-batch") == 0 && i + 1 < argc)
+      weaselBatch = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-maxgens") == 0 && i + 1 < argc)
+      weaselGenerationLimit = atol(argv[++i]);
+    else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+      weaselThreads = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-local") == 0 && i + 1 < argc)
+      weaselLocalSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-localgens") == 0 && i + 1 < argc)
+      weaselLocalGenerations = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+      weaselTournamentSize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-interval") == 0 && i + 1 < argc)
+      config.migrationInterval = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-migrants") == 0 && i + 1 < argc)
+      config.migrants = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-topology") == 0 && i + 1 < argc && (strcmp(argv[i+1], "ring") == 0 || strcmp(argv[i+1], "random") == 0))
+      config.topology = strcmp(argv[++i], "ring") == 0 ? TOPOLOGY_RING : TOPOLOGY_RANDOM;
+    else
+      break;
+  }
+  if(i < argc || config.migrationInterval < 1 || config.migrants < 1 || POOLSIZE < 2 || weaselTournamentSize < 1 || weaselBatch < 0 || weaselBatch % 2 || weaselThreads < 0 || weaselLocalGenerations < 1 || weaselGenerationLimit < 0 || weaselLocalSize < (weaselBatch ? weaselBatch : 2) || weaselLocalSize < weaselThreads || config.migrants > POOLSIZE || strlen(validChars) < 2 || strlen(validChars) > 256 || (!island && worldSz < 2)) {
+    if(rank==MASTER)
+      fprintf(stderr, "Usage: %s [-target string | -targetfile path | -randomtarget length] [-alphabet characters] [-pool size] [-selection biased|roulette|tournament] [-k tournamentSize] [-batch evenCount] [-threads count [-local size] [-localgens generations]] [-adaptive] [-async] [-maxgens generations] [--seed n] [-island [-interval generations] [-migrants count] [-topology ring|random]]\n"
+        "  The master and node modes need at least 2 ranks, island mode runs on any number\n", argv[0]);
+    MPI_Finalize();
+    return 1;
+  }
+  if(weaselThreads && provided < MPI_THREAD_FUNNELED && rank==MASTER)
+    printf("Warning: MPI only provides thread level %d, continuing anyway\n", provided);
+
+  if(!seeded) //Every rank takes the master's clock so a run can be repeated with the seed it prints
+    seed = time(NULL);
+  MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, MASTER, MPI_COMM_WORLD);
+  weaselSeed = seed;
+  rngSeed(&weaselRandom, seed, rank, 0);
+
+  if(rank==MASTER) { //The master settles the target and every rank gets a copy
+    target = buildTarget(targetFile, randomLength, seed, worldSz);
+    targetLength = target ? strlen(target) : 0;
+    if(targetLength == 0 || strspn(target, validChars) != (size_t)targetLength) {
+      fprintf(stderr, "The target must be at least one character, all from the alphabet \"%s\"\n", validChars);
+      targetLength = -1;
+    }
+  }
+  MPI_Bcast(&targetLength, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+  if(targetLength < 0) {
+    free(target);
+    MPI_Finalize();
+    return 1;
+  }
+  if(rank!=MASTER)
+    target = malloc(targetLength + 1);
+  MPI_Bcast(target, targetLength + 1, MPI_CHAR, MASTER, MPI_COMM_WORLD);
+  targetStr = target;
+  initFitnessTables(&weaselTables, validChars, targetStr);
+  initGenomeLayout(&weaselGenome, &weaselTables, validChars, targetStr);
+  if(rank==MASTER)
+    printf("Seed %llu, target of %d symbols from %d, %d bits each in %d words\n", seed, TARGETLEN, VALIDLEN, weaselGenome.bits, GENOMEWORDS);
+  if(island)
+    islandLogic(rank, worldSz, &config);
+  else if(async && rank==MASTER)
+    asyncMasterLogic(worldSz);
+  else if(async)
+    asyncNodeLogic(rank);
+  else if(rank==MASTER)
+    masterLogic(worldSz);
+  else
+    nodeLogic(rank);
+  
+  freeGenomeLayout(&weaselGenome);
+  freeFitnessTables(&weaselTables);
+  free(target);
+  MPI_Finalize();
+  return 0;
+}
+
+#endif
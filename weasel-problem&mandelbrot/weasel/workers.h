@@ -0,0 +1,168 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+//Threaded local populations for the nodes, turned on with -threads. Instead of breeding only the parents it
+//was sent, a node keeps a population of -local genomes and a pool of threads evolves it for -localgens
+//generations between exchanges with the master. Parents from the master replace the least fit local genomes,
+//and what goes back is the fittest of the population, as many as the master sent.
+//A local generation is two phases split by barriers. Each thread first breeds a child for every slot of its
+//slice from tournament picks over the whole population, which is only read, and scores it. Then each thread
+//keeps a child in its slot if it is at least as fit as the genome there. No slot is written by two threads
+//and nothing is read while it is written, so no locks are needed. Threads draw from their own random
+//streams and only the node's main thread calls MPI.
+
+#include <pthread.h>
+
+typedef struct localPopulation localPopulation;
+
+typedef struct {
+  localPopulation* local;
+  int id;
+} localWorker;
+
+struct localPopulation {
+  int size, threads, generations;
+  genomeWord* population; //size genomes, and their fitnesses
+  int* fitness;
+  genomeWord* offspring; //One child per slot each generation
+  int* offspringFitness;
+  genomeWord* scratch; //One genome per thread for the second parent
+  poolSelector selector; //Tournament over the population
+  pthread_t* handles;
+  localWorker* workers; //Thread arguments
+  pthread_barrier_t phase; //Between the phases of a generation, threads only
+  pthread_barrier_t round; //Starts and ends a round of generations, threads and the main thread
+  int rank, quit;
+  long* evaluations; //Per thread, summed by the main thread between rounds
+  operatorSchedule* schedules; //Per thread, with -adaptive
+};
+
+
+void* localWorkerThread(void* arg) {
+  localWorker* worker = arg;
+  localPopulation* local = worker->local;
+  int i, generation, parent1, parent2, childFitness[2], first = local->size * worker->id / local->threads, last = local->size * (worker->id + 1) / local->threads;
+  genomeWord* other = GENOME(local->scratch, worker->id);
+
+  rngSeed(&weaselRandom, weaselSeed, local->rank, worker->id + 1); //Stream 0 of the rank is its main thread's
+  while(1) {
+    pthread_barrier_wait(&local->round);
+    if(local->quit)
+      break;
+    for(generation=0;generation<local->generations;++generation) {
+      for(i=first;i<last;++i) { //Breed and score a child for every slot of the slice
+        parent1 = selectString(&local->selector);
+        parent2 = selectString(&local->selector);
+        memcpy(GENOME(local->offspring, i), GENOME(local->population, parent1), GENOMEWORDS * sizeof(genomeWord));
+        memcpy(other, GENOME(local->population, parent2), GENOMEWORDS * sizeof(genomeWord));
+        if(weaselAdaptive) { //Both children are scored, the slot gets the better one
+          breedAdaptive(&local->schedules[worker->id], GENOME(local->offspring, i), other,
+            local->fitness[parent1] > local->fitness[parent2] ? local->fitness[parent1] : local->fitness[parent2], childFitness);
+          local->offspringFitness[i] = childFitness[0];
+          if(childFitness[1] > childFitness[0]) {
+            memcpy(GENOME(local->offspring, i), other, GENOMEWORDS * sizeof(genomeWord));
+            local->offspringFitness[i] = childFitness[1];
+          }
+          local->evaluations[worker->id]++;
+        }
+        else {
+          crossOverGenomes(GENOME(local->offspring, i), other);
+          mutateGenome(GENOME(local->offspring, i));
+          local->offspringFitness[i] = getFitness(GENOME(local->offspring, i));
+        }
+      }
+      local->evaluations[worker->id] += last - first;
+      pthread_barrier_wait(&local->phase);
+      for(i=first;i<last;++i) //Keep children at least as fit as the genome they replace
+        if(local->offspringFitness[i] >= local->fitness[i]) {
+          memcpy(GENOME(local->population, i), GENOME(local->offspring, i), GENOMEWORDS * sizeof(genomeWord));
+          local->fitness[i] = local->offspringFitness[i];
+        }
+      pthread_barrier_wait(&local->phase);
+    }
+    pthread_barrier_wait(&local->round);
+  }
+  return NULL;
+}
+
+
+void initLocalPopulation(localPopulation* local, int size, int threads, int generations, int rank) {
+  int i;
+  local->size = size;
+  local->threads = threads;
+  local->generations = generations;
+  local->rank = rank;
+  local->quit = 0;
+  local->population = allocGenomePool(&weaselGenome, size);
+  local->offspring = allocGenomePool(&weaselGenome, size);
+  local->scratch = allocGenomePool(&weaselGenome, threads);
+  local->fitness = malloc(size * sizeof(int));
+  local->offspringFitness = malloc(size * sizeof(int));
+  local->evaluations = calloc(threads, sizeof(long));
+  local->handles = malloc(threads * sizeof(pthread_t));
+  local->workers = malloc(threads * sizeof(localWorker));
+  local->schedules = malloc(threads * sizeof(operatorSchedule));
+  for(i=0;i<size;++i)
+    generateGenome(GENOME(local->population, i));
+  getPoolFitness(local->population, size, local->fitness);
+  initSelector(&local->selector, SELECTION_TOURNAMENT, weaselTournamentSize, local->fitness, size, 0);
+  pthread_barrier_init(&local->phase, NULL, threads);
+  pthread_barrier_init(&local->round, NULL, threads + 1);
+  for(i=0;i<threads;++i) {
+    local->workers[i].local = local;
+    local->workers[i].id = i;
+    initSchedule(&local->schedules[i], TARGETLEN);
+    pthread_create(&local->handles[i], NULL, localWorkerThread, &local->workers[i]);
+  }
+}
+
+
+void evolveLocal(localPopulation* local, genomeWord* genomes, int count) { //Folds in count parents, evolves, returns the count fittest in their place
+  int i, j, worst;
+  int* best = malloc(count * sizeof(int));
+  for(i=0;i<count;++i) { //Each parent replaces the least fit local genome
+    for(worst=0, j=1;j<local->size;++j)
+      if(local->fitness[j] < local->fitness[worst])
+        worst = j;
+    memcpy(GENOME(local->population, worst), GENOME(genomes, i), GENOMEWORDS * sizeof(genomeWord));
+    local->fitness[worst] = getFitness(GENOME(genomes, i));
+  }
+  pthread_barrier_wait(&local->round); //Let the threads run their generations
+  pthread_barrier_wait(&local->round);
+  findBestIndices(local->fitness, local->size, count, best);
+  for(i=0;i<count;++i)
+    memcpy(GENOME(genomes, i), GENOME(local->population, best[i]), GENOMEWORDS * sizeof(genomeWord));
+  free(best);
+}
+
+
+long localEvaluations(const localPopulation* local) { //Fitness evaluations by the threads so far
+  long total = 0;
+  int i;
+  for(i=0;i<local->threads;++i)
+    total += local->evaluations[i];
+  return total;
+}
+
+
+void freeLocalPopulation(localPopulation* local) {
+  int i;
+  local->quit = 1;
+  pthread_barrier_wait(&local->round);
+  for(i=0;i<local->threads;++i)
+    pthread_join(local->handles[i], NULL);
+  pthread_barrier_destroy(&local->phase);
+  pthread_barrier_destroy(&local->round);
+  freeSelector(&local->selector);
+  free(local->population);
+  free(local->offspring);
+  free(local->scratch);
+  free(local->fitness);
+  free(local->offspringFitness);
+  free(local->evaluations);
+  free(local->handles);
+  free(local->workers);
+  free(local->schedules);
+}
+
+#endif